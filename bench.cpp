@@ -0,0 +1,37 @@
+#include <chrono>
+#include <cstdlib>
+#include "rdg.h"
+
+//times every phase of create_dungeon, built once per grid layout: rdg-bench and rdg-bench-tiled
+//usage: rdg-bench [size ...], sizes default to 4097 and 8193
+int main(int argc, char **argv) {
+    static const char *phases[] = {"init_cells", "emplace_rooms", "open_rooms", "label_rooms",
+                                   "corridors", "emplace_stairs", "clean_dungeon"};
+    std::vector<int> sizes;
+    for (int i = 1; i < argc; i++) {
+        sizes.push_back(std::atoi(argv[i]));
+    }
+    if (sizes.empty()) {
+        sizes = {4097, 8193};
+    }
+
+    std::cout << "layout " << (rdg<>::Grid::ROW_MAJOR ? "row-major" : "tiled") << std::endl;
+    for (auto size: sizes) {
+        rdg<>::Options options;
+        options.n_rows = size;
+        options.n_cols = size;
+        options.remove_deadends = 50;
+
+        rdg<>::Generator generator(options, 1);
+        auto total = 0.0;
+        for (auto phase = 0; phase < rdg<>::DONE; phase++) {
+            auto start = std::chrono::steady_clock::now();
+            generator.runPhase();
+            auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            total += ms;
+            std::cout << size << "x" << size << " " << phases[phase] << " " << ms << " ms" << std::endl;
+        }
+        std::cout << size << "x" << size << " total " << total << " ms" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,142 @@
+#include <queue>
+#include <random>
+#include "rdg_distance.h"
+
+using Distance = rdg_distance<>;
+
+//cell-level Dijkstra over the same weights, what compute() and update() must agree with
+static std::vector<uint32_t> reference(const rdg<>::Dungeon &dungeon, const Distance &field,
+                                       const std::vector<std::pair<int, int>> &sources) {
+    const auto &cells = dungeon.getCells();
+    int n_rows = cells.size();
+    int n_cols = cells.stride();
+    std::vector<uint32_t> distances(size_t(n_rows) * n_cols, Distance::UNREACHABLE);
+    std::priority_queue<std::pair<uint32_t, size_t>, std::vector<std::pair<uint32_t, size_t>>, std::greater<>> queue;
+    for (auto [r, c]: sources) {
+        if (field.weight(cells[r][c])) {
+            distances[size_t(r) * n_cols + c] = 0;
+            queue.push({0, size_t(r) * n_cols + c});
+        }
+    }
+    while (!queue.empty()) {
+        auto [d, cell] = queue.top();
+        queue.pop();
+        if (d != distances[cell]) {
+            continue;
+        }
+        int r = cell / n_cols;
+        int c = cell % n_cols;
+        int next[4][2] = {{r - 1, c}, {r + 1, c}, {r, c - 1}, {r, c + 1}};
+        for (auto [nr, nc]: next) {
+            if (nr < 0 || nc < 0 || nr >= n_rows || nc >= n_cols) {
+                continue;
+            }
+            auto w = field.weight(cells[nr][nc]);
+            auto at = size_t(nr) * n_cols + nc;
+            if (w && d + w < distances[at]) {
+                distances[at] = d + w;
+                queue.push({d + w, at});
+            }
+        }
+    }
+    return distances;
+}
+
+//checks compute() and update() against a cell-level Dijkstra across corridor layouts, room layouts,
+//door costs, sources inside corridors and rooms and random cell edits, built as rdg-distance and run by ctest
+int main() {
+    static const rdg<>::CorridorLayout layouts[] = {rdg<>::LABYRINTH, rdg<>::BENT, rdg<>::STRAIGHT};
+    static const char *room_layouts[] = {"Scattered", "Packed", "Fitted"};
+    auto checks = 0;
+    for (unsigned seed = 0; seed < 18; seed++) {
+        rdg<>::Options options;
+        options.n_rows = seed % 6 == 5 ? 257 : 81;
+        options.n_cols = seed % 6 == 5 ? 257 : 121;
+        options.corridor_layout = layouts[seed % 3];
+        options.room_layout = room_layouts[seed / 3 % 3];
+        options.remove_deadends = seed % 2 ? 0 : 60;
+        options.room_max = seed % 4 ? 9 : 15;
+        options.add_stairs = 4;
+        auto dungeon = rdg<>::create_dungeon(options, seed);
+        dungeon.setJournaling(false);
+        const auto &cells = dungeon.getCells();
+        int n_rows = cells.size();
+        int n_cols = cells.stride();
+
+        Distance::Costs costs;
+        costs.locked = 1 + seed * 7 % 40;
+        costs.trapped = seed % 3 ? 5 : 0;
+        costs.secret = seed % 4 ? 2 : Distance::MAX_COST;
+        Distance field(dungeon, costs);
+
+        std::mt19937 rng(seed);
+        std::vector<std::pair<int, int>> sources;
+        for (const auto &stairs: dungeon.getStairs()) {
+            sources.push_back({stairs.row, stairs.col});
+        }
+        while (sources.size() < 12) {
+            int r = rng() % n_rows;
+            int c = rng() % n_cols;
+            if (cells[r][c].isOpenspace()) {
+                sources.push_back({r, c});
+            }
+        }
+
+        auto check = [&](const char *what, int step) {
+            checks++;
+            if (field.getDistances() != reference(dungeon, field, sources)) {
+                std::cerr << what << " differs from Dijkstra, seed " << seed << " step " << step << std::endl;
+                return false;
+            }
+            return true;
+        };
+        field.compute(sources);
+        if (!check("compute()", 0)) {
+            return 1;
+        }
+
+        //doors change their type, random cells open or close, then the next compute() indexes again
+        const auto &doors = dungeon.getDoors();
+        for (int step = 1; step <= 40; step++) {
+            int r;
+            int c;
+            if (step % 2 && !doors.empty()) {
+                const auto &door = doors[rng() % doors.size()];
+                r = door.row;
+                c = door.col;
+            } else {
+                r = 1 + rng() % (n_rows - 2);
+                c = 1 + rng() % (n_cols - 2);
+            }
+            auto change = rng() % 5;
+            dungeon.edit(r, c, [&](rdg<>::Cell &cell) {
+                if (change == 0) {
+                    cell.addType(rdg<>::LOCKED);
+                } else if (change == 1) {
+                    cell.addType(rdg<>::TRAPPED);
+                } else if (change == 2) {
+                    cell.removeType(rdg<>::LOCKED);
+                    cell.removeType(rdg<>::TRAPPED);
+                    cell.removeType(rdg<>::SECRET);
+                } else if (change == 3) {
+                    cell.removeType(rdg<>::ROOM);
+                    cell.removeType(rdg<>::CORRIDOR);
+                } else {
+                    cell.addType(rdg<>::CORRIDOR);
+                }
+            });
+            field.update(r, c, cells[r][c]);
+            if (!check("update()", step)) {
+                return 1;
+            }
+            if (step % 10 == 0) {
+                field.compute(sources);
+                if (!check("compute() after update()", step)) {
+                    return 1;
+                }
+            }
+        }
+    }
+    std::cout << "distance fields matched Dijkstra in " << checks << " checks" << std::endl;
+    return 0;
+}
@@ -0,0 +1,34 @@
+#include "rdg.h"
+
+//drives rdg<>::generate() in short slices and checks it ends with the dungeon create_dungeon makes,
+//built as C++20 (rdg-generate) so the coroutine wrapper keeps compiling
+int main() {
+    rdg<>::Options options;
+    options.n_rows = 129;
+    options.n_cols = 129;
+
+    auto task = rdg<>::generate(options, 1, std::chrono::microseconds(50));
+    auto slices = 0;
+    while (task.resume()) {
+        slices++;
+    }
+    auto dungeon = task.take();
+    if (!dungeon) {
+        std::cerr << "generate() finished without a dungeon" << std::endl;
+        return 1;
+    }
+
+    auto expected = rdg<>::create_dungeon(options, 1);
+    const auto &cells = dungeon->getCells();
+    const auto &expected_cells = expected.getCells();
+    for (size_t r = 0; r < cells.size(); r++) {
+        for (size_t c = 0; c < cells.stride(); c++) {
+            if (cells[r][c].getFlags() != expected_cells[r][c].getFlags()) {
+                std::cerr << "generate() differs from create_dungeon at " << r << "," << c << std::endl;
+                return 1;
+            }
+        }
+    }
+    std::cout << "generate() matched create_dungeon after " << slices << " slices" << std::endl;
+    return 0;
+}
@@ -2,22 +2,33 @@
 
 int main() {
     auto dungeon = rdg<>::create_dungeon(rdg<>::Options());
+    std::vector<std::string> lines;
     for (const auto &row:dungeon.getCells()) {
+        std::string line;
         for (auto cell:row) {
             if (cell.hasLabel()) {
-                std::cout << cell.getLabel();
+                line += cell.getLabel();
             } else if (cell.hasType(rdg<>::ROOM)) {
-                std::cout << "X";
+                line += "X";
             } else if (cell.hasType(rdg<>::CORRIDOR)) {
-                std::cout << "x";
+                line += "x";
             } else if (cell.isDoorspace()) {
-                std::cout << "D";
+                line += "D";
             } else {
-                std::cout << " ";
+                line += " ";
             }
-            std::cout << " ";
+            line += " ";
         }
-        std::cout << std::endl;
+        lines.push_back(std::move(line));
+    }
+    for (const auto &room:dungeon.getRooms()) {
+        auto label = std::to_string(room.id);
+        for (size_t c = 0; c < label.size(); c++) {
+            lines[room.label_row][(room.label_col + c) * 2] = label[c];
+        }
+    }
+    for (const auto &line:lines) {
+        std::cout << line << std::endl;
     }
     return 0;
 }
@@ -3,8 +3,28 @@
 #include <iostream>
 #include <utility>
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <cmath>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <functional>
+#include <chrono>
+#include <optional>
+#ifdef __cpp_impl_coroutine
+#include <coroutine>
+#endif
+#include <numeric>
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <climits>
+#include <charconv>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 #include <vstd.h>
 
 template<typename T=void>
@@ -26,69 +46,120 @@ public:
         STAIR_UP
     };
 
+    //the types a door cell can carry, as Cell flag bits
+    static constexpr uint32_t DOORSPACE = 1u << ARCH | 1u << DOOR | 1u << LOCKED
+                                          | 1u << TRAPPED | 1u << SECRET | 1u << PORTC;
+
     enum CorridorLayout {
         BENT = 50,
         STRAIGHT = 100,
         LABYRINTH = 0
     };
+
+    //create_dungeon phases, in the order they run
+    enum Phase {
+        INIT_CELLS,
+        EMPLACE_ROOMS,
+        OPEN_ROOMS,
+        LABEL_ROOMS,
+        CORRIDORS,
+        EMPLACE_STAIRS,
+        CLEAN_DUNGEON,
+        DONE
+    };
+
+    class Generator;
+
+    //heap allocations made by the calling thread, only counted when RDG_COUNT_ALLOCATIONS is defined
+    static size_t &allocation_count() {
+        thread_local size_t count = 0;
+        return count;
+    }
+
 private:
+    using Rng = std::mt19937;
+
+    template<typename N>
+    static N random(Rng &rng, N n) {
+        if (!(n > 0)) {
+            return 0;
+        }
+        if constexpr (std::is_floating_point_v<N>) {
+            return std::uniform_real_distribution<N>(0, n)(rng);
+        } else {
+            return std::uniform_int_distribution<N>(0, n - 1)(rng);
+        }
+    }
+
     static std::map<std::string, std::vector<std::vector<int>>> DUNGEON_LAYOUT;
+    //read concurrently by corridor and search workers, so only through at() and find(), never operator[]
     static std::map<std::string, int> DI;
     static std::map<std::string, int> DJ;
     static std::map<std::string, std::map<std::string, std::vector<std::vector<int>>>> STAIR_END;
     static std::map<std::string, std::map<std::string, std::vector<std::vector<int>>>> CLOSE_END;
     static std::map<std::string, std::string> OPPOSITE;
 public:
+    //types as bits (1 << CellType) with the label character in the top byte, as dungeon.pl packs cells
     class Cell {
-        std::set<CellType> types;
-        int room_id;
-        std::string label;
+        uint32_t flags = 0;
+        int32_t room_id = 0;
+
+        static constexpr uint32_t LABEL_SHIFT = 24;
+        static constexpr uint32_t TYPE_MASK = (1u << LABEL_SHIFT) - 1;
     public:
         void setType(CellType type) {
-            types.clear();
+            clearTypes();
             addType(type);
         }
 
-        bool isBlockedRoom() {
+        bool isBlockedRoom() const {
             return hasType(BLOCKED)
                    || hasType(ROOM);
         }
 
-        bool isBlockedCorridor() {
+        bool isBlockedCorridor() const {
             return hasType(BLOCKED)
                    || hasType(PERIMETER)
                    || hasType(CORRIDOR);
         }
 
-        bool isBlockedDoor() {
+        bool isBlockedDoor() const {
             return hasType(BLOCKED)
                    || isDoorspace();
         }
 
-        bool hasLabel() {
-            return !label.empty();
+        bool hasLabel() const {
+            return flags >> LABEL_SHIFT;
         }
 
-        std::string getLabel() {
-            return label;
+        std::string getLabel() const {
+            return hasLabel() ? std::string(1, char(flags >> LABEL_SHIFT)) : std::string();
         }
 
-        bool isEspace() {
+        bool isEspace() const {
             return hasType(ENTRANCE)
                    || isDoorspace()
                    || hasLabel();
         }
 
         void addType(CellType type) {
-            types.insert(type);
+            flags |= 1u << type;
         }
 
         void removeType(CellType type) {
-            types.erase(type);
+            flags &= ~(1u << type);
         }
 
         bool hasType(CellType type) const {
-            return vstd::ctn(types, type);
+            return flags & (1u << type);
+        }
+
+        uint32_t getFlags() const {
+            return flags;
+        }
+
+        void setFlags(uint32_t flags) {
+            this->flags = flags;
         }
 
         bool isOpenspace() const {
@@ -96,16 +167,11 @@ public:
                    || hasType(CORRIDOR);
         }
 
-        bool isDoorspace() {
-            return hasType(ARCH)
-                   || hasType(DOOR)
-                   || hasType(LOCKED)
-                   || hasType(TRAPPED)
-                   || hasType(SECRET)
-                   || hasType(PORTC);
+        bool isDoorspace() const {
+            return flags & DOORSPACE;
         }
 
-        bool isStairs() {
+        bool isStairs() const {
             return hasType(STAIR_UP)
                    || hasType(STAIR_DN);
         }
@@ -114,31 +180,170 @@ public:
             this->room_id = room_id;
         }
 
-        int getRoomId() {
+        int getRoomId() const {
             return room_id;
         }
 
-        void setLabel(std::string label) {
-            this->label = std::move(label);
+        void setLabel(const std::string &label) {
+            flags = (flags & TYPE_MASK) | (label.empty() ? 0 : uint32_t(uint8_t(label[0])) << LABEL_SHIFT);
         }
 
         void clearTypes() {
-            types.clear();
+            flags &= ~TYPE_MASK;
         }
 
         void clearLabel() {
-            label = "";
+            flags &= TYPE_MASK;
         }
 
         void clearEspace() {
             clearLabel();
             removeType(ENTRANCE);
-            removeType(ARCH);
-            removeType(DOOR);
-            removeType(LOCKED);
-            removeType(TRAPPED);
-            removeType(SECRET);
-            removeType(PORTC);
+            flags &= ~DOORSPACE;
+        }
+    };
+
+    //cells of a dungeon in one buffer, indexed as grid[r][c]; rows are contiguous unless RDG_TILED_GRID
+    //is defined, which stores TILE x TILE tiles, row-major inside a tile and from tile to tile, so the
+    //3x3 to 5x5 neighbourhoods the phases read mostly stay within a tile
+    class Grid {
+    public:
+#ifdef RDG_TILED_GRID
+        static constexpr int TILE = 8;
+#else
+        static constexpr int TILE = 1;
+#endif
+        static constexpr bool ROW_MAJOR = TILE == 1;
+
+        template<typename C>
+        class CellIterator {
+        public:
+            CellIterator(C *first, size_t c) : first(first), c(c) {}
+
+            C &operator*() const {
+                return first[offset(c)];
+            }
+
+            CellIterator &operator++() {
+                c++;
+                return *this;
+            }
+
+            bool operator!=(const CellIterator &other) const {
+                return c != other.c;
+            }
+
+        private:
+            C *first;
+            size_t c;
+        };
+
+        template<typename C>
+        class Row {
+        public:
+            Row(C *first, size_t n) : first(first), n(n) {}
+
+            C &operator[](size_t c) const {
+                return first[offset(c)];
+            }
+
+            CellIterator<C> begin() const {
+                return {first, 0};
+            }
+
+            CellIterator<C> end() const {
+                return {first, n};
+            }
+
+            size_t size() const {
+                return n;
+            }
+
+        private:
+            C *first; //first cell of the row within its first tile
+            size_t n;
+        };
+
+        template<typename C>
+        class RowIterator {
+        public:
+            RowIterator(const Grid *grid, int r) : grid(grid), r(r) {}
+
+            Row<C> operator*() const {
+                return (*grid)[r];
+            }
+
+            RowIterator &operator++() {
+                r++;
+                return *this;
+            }
+
+            bool operator!=(const RowIterator &other) const {
+                return r != other.r;
+            }
+
+        private:
+            const Grid *grid;
+            int r;
+        };
+
+        void assign(int rows, int cols) {
+            n_rows = rows;
+            n_cols = cols;
+            tiles_j = (cols + TILE - 1) / TILE;
+            cells.assign(size_t((rows + TILE - 1) / TILE) * tiles_j * TILE * TILE, Cell());
+        }
+
+        Row<Cell> operator[](int r) {
+            return {cells.data() + row_offset(r), size_t(n_cols)};
+        }
+
+        Row<const Cell> operator[](int r) const {
+            return {cells.data() + row_offset(r), size_t(n_cols)};
+        }
+
+        RowIterator<const Cell> begin() const {
+            return {this, 0};
+        }
+
+        RowIterator<const Cell> end() const {
+            return {this, n_rows};
+        }
+
+        size_t size() const {
+            return n_rows;
+        }
+
+        bool empty() const {
+            return cells.empty();
+        }
+
+        //cells per row, which is also the row stride of data() when ROW_MAJOR
+        size_t stride() const {
+            return n_cols;
+        }
+
+        //storage order, see TILE
+        Cell *data() {
+            return cells.data();
+        }
+
+        const Cell *data() const {
+            return cells.data();
+        }
+
+    private:
+        int n_rows = 0;
+        int n_cols = 0;
+        int tiles_j = 0;
+        std::vector<Cell> cells;
+
+        static size_t offset(size_t c) {
+            return c / TILE * TILE * TILE + c % TILE;
+        }
+
+        size_t row_offset(int r) const {
+            return (size_t(r) / TILE * tiles_j * TILE + r % TILE) * TILE;
         }
     };
 
@@ -156,7 +361,10 @@ public:
         int width;
         int area;
 
-        std::multimap<std::string, Door> door;
+        int door_index = 0; //first of this room's doors in getDoors()
+        int door_count = 0;
+        int label_row = 0; //cell of the first digit of the id, as label_rooms centres it
+        int label_col = 0; //the label may overhang a room narrower than the id, it stays inside the grid
     };
 
     struct Stairs {
@@ -173,21 +381,24 @@ public:
         std::string dungeon_layout = "None";
         int room_min = 3; //minimum rooms size
         int room_max = 9; //maximum rooms size
-        std::string room_layout = "Scattered";  //Packed, Scattered
+        std::string room_layout = "Scattered";  //Packed, Scattered, Fitted
         CorridorLayout corridor_layout = LABYRINTH;
         int remove_deadends = 100;//percentage
         int add_stairs = 2; //number of stairs
         std::string map_style = "Standard";
         int cell_size = 18; //pixels
+        int corridor_band = 0; //band height in nodes for banded corridor carving, 0 carves the whole grid at once
+        int threads = 1; //worker threads for banded corridor carving
+        bool journal = false; //record cell changes in getJournal() from generation on
     };
 
     struct Sill {
-        const int sill_r;
-        const int sill_c;
-        const std::string dir;
-        const int door_r;
-        const int door_c;
-        const int out_id;
+        int sill_r;
+        int sill_c;
+        std::string dir;
+        int door_r;
+        int door_c;
+        int out_id;
     };
 
     struct Door {
@@ -195,66 +406,1029 @@ public:
         int col;
         std::string key;
         std::string type;
-        int out_id;
+        int out_id = 0;
+        std::string dir; //side of the owning room the door is on
+    };
+
+    //cell flag changes, index is row * stride + col; room ids are not tracked
+    struct Delta {
+        uint32_t index;
+        uint32_t before;
+        uint32_t after;
+    };
+
+    class Journal {
+    public:
+        void record(uint32_t index, uint32_t before, uint32_t after) {
+            deltas.push_back({index, before, after});
+        }
+
+        const std::vector<Delta> &getDeltas() const {
+            return deltas;
+        }
+
+        bool empty() const {
+            return deltas.empty();
+        }
+
+        void clear() {
+            deltas.clear();
+        }
+
+        //merges repeated edits of a cell into one delta and drops those that end where they started,
+        //leaving the deltas ordered by index
+        void compact() {
+            std::stable_sort(deltas.begin(), deltas.end(), [](const Delta &a, const Delta &b) {
+                return a.index < b.index;
+            });
+            size_t kept = 0;
+            for (size_t k = 0; k < deltas.size();) {
+                auto merged = deltas[k];
+                for (k++; k < deltas.size() && deltas[k].index == merged.index; k++) {
+                    merged.after = deltas[k].after;
+                }
+                if (merged.before != merged.after) {
+                    deltas[kept++] = merged;
+                }
+            }
+            deltas.resize(kept);
+        }
+
+        //appends the deltas as LEB128 varints: count, then per delta the zigzagged index step,
+        //the old flags and the bits that changed
+        void encode(std::vector<uint8_t> &out) const {
+            put(out, deltas.size());
+            uint32_t index = 0;
+            for (const auto &delta: deltas) {
+                auto step = int64_t(delta.index) - index;
+                put(out, uint64_t(step) << 1 ^ uint64_t(step >> 63));
+                put(out, delta.before);
+                put(out, delta.before ^ delta.after);
+                index = delta.index;
+            }
+        }
+
+        //appends the deltas read from encode()'s output, false when it is truncated or malformed
+        static bool decode(const uint8_t *data, size_t size, std::vector<Delta> &out) {
+            auto end = data + size;
+            uint64_t count;
+            if (!get(data, end, count)) {
+                return false;
+            }
+            uint32_t index = 0;
+            for (uint64_t k = 0; k < count; k++) {
+                uint64_t step, before, changed;
+                if (!get(data, end, step) || !get(data, end, before) || !get(data, end, changed)) {
+                    return false;
+                }
+                index += uint32_t(int64_t(step >> 1) ^ -int64_t(step & 1));
+                out.push_back({index, uint32_t(before), uint32_t(before ^ changed)});
+            }
+            return data == end;
+        }
+
+        //applies deltas to a snapshot, false at the first one outside the grid or, when strict,
+        //whose old flags do not match the snapshot
+        static bool replay(const std::vector<Delta> &deltas, Grid &cells, bool strict = true) {
+            auto n = cells.size() * cells.stride();
+            for (const auto &delta: deltas) {
+                if (delta.index >= n) {
+                    return false;
+                }
+                auto &cell = cells[delta.index / cells.stride()][delta.index % cells.stride()];
+                if (strict && cell.getFlags() != delta.before) {
+                    return false;
+                }
+                cell.setFlags(delta.after);
+            }
+            return true;
+        }
+
+    private:
+        std::vector<Delta> deltas;
+
+        static void put(std::vector<uint8_t> &out, uint64_t value) {
+            for (; value >= 0x80; value >>= 7) {
+                out.push_back(uint8_t(value) | 0x80);
+            }
+            out.push_back(uint8_t(value));
+        }
+
+        static bool get(const uint8_t *&data, const uint8_t *end, uint64_t &value) {
+            value = 0;
+            for (int shift = 0; shift < 64 && data < end; shift += 7) {
+                auto byte = *data++;
+                value |= uint64_t(byte & 0x7f) << shift;
+                if (!(byte & 0x80)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    //thumbnail of a dungeon on its node grid (node (i, j) is cell (2i + 1, 2j + 1)), one pixel per
+    //scale x scale nodes holding the strongest kind among them
+    struct Preview {
+        enum Pixel : uint8_t {
+            EMPTY,
+            BLOCKED,
+            CORRIDOR,
+            ROOM
+        };
+
+        int rows = 0;
+        int cols = 0;
+        int scale = 1;
+        std::vector<uint8_t> pixels; //row-major
+
+        Pixel get(int r, int c) const {
+            return Pixel(pixels[size_t(r) * cols + c]);
+        }
+    };
+
+private:
+    //maximal free rectangles of the node grid, bucketed by position and weighted per room size
+    class FreeRects {
+    public:
+        struct Rect {
+            int i;
+            int j;
+            int height;
+            int width;
+        };
+
+        //empties the index, keeping its storage when the grid and room sizes allow it
+        void reset(int _n_i, int _n_j, int _room_base, int _room_radix) {
+            n_i = _n_i;
+            n_j = _n_j;
+            room_base = _room_base;
+            room_radix = _room_radix;
+            bins_i = (n_i + BIN - 1) / BIN;
+            bins_j = (n_j + BIN - 1) / BIN;
+            bins.resize(std::max<size_t>(bins.size(), bins_i * bins_j));
+            for (auto &bin: bins) {
+                bin.clear();
+            }
+            weights.resize(std::max<size_t>(weights.size(), room_radix * room_radix));
+            for (auto &tree: weights) {
+                tree.assign(capacity + 1, 0);
+            }
+            std::fill(alive.begin(), alive.end(), 0);
+            free_slots.clear();
+            for (int slot = capacity - 1; slot >= 0; slot--) {
+                free_slots.push_back(slot);
+            }
+        }
+
+        //seeds the index with every maximal rectangle of nodes for which blocked(i, j) is false
+        template<typename F>
+        void init(F blocked) {
+            heights.assign(n_j + 1, 0);
+            free_above.assign(n_j + 1, 0);
+
+            for (int i = 0; i < n_i; i++) {
+                for (int j = 0; j < n_j; j++) {
+                    heights[j] = blocked(i, j) ? 0 : heights[j] + 1;
+                }
+                //prefix count of free nodes in the next row, to tell whether a rectangle extends downwards
+                free_above[0] = 0;
+                for (int j = 0; j < n_j; j++) {
+                    free_above[j + 1] = free_above[j] + (i + 1 < n_i && !blocked(i + 1, j));
+                }
+
+                stack.clear();
+                for (int j = 0; j <= n_j; j++) {
+                    int start = j;
+                    while (!stack.empty() && stack.back().second >= heights[j]) {
+                        auto [s, h] = stack.back();
+                        stack.pop_back();
+                        if (h > heights[j] && free_above[j] - free_above[s] != j - s) {
+                            insert({i - h + 1, s, h, j - s});
+                        }
+                        start = s;
+                    }
+                    if (heights[j] > 0) {
+                        stack.emplace_back(start, heights[j]);
+                    }
+                }
+            }
+        }
+
+        //picks a uniformly weighted position where a room of the given size fits
+        std::optional<Rect> sample(int height, int width, Rng &rng) {
+            auto &tree = weights[size_class(height, width)];
+            auto total = sum(tree, capacity);
+            if (total <= 0) {
+                return {};
+            }
+            auto x = random(rng, total);
+            int slot = 0;
+            for (int step = highest_bit(capacity); step > 0; step >>= 1) {
+                if (slot + step <= capacity && tree[slot + step] <= x) {
+                    slot += step;
+                    x -= tree[slot];
+                }
+            }
+            auto &rect = rects[slot];
+            int cols = rect.width - width + 1;
+            return Rect{rect.i + int(x / cols), rect.j + int(x % cols), height, width};
+        }
+
+        //splits every free rectangle overlapping a placed room, keeping only the maximal leftovers
+        void place(const Rect &room) {
+            query(room, hit);
+            split.clear();
+            for (auto slot: hit) {
+                auto f = rects[slot];
+                if (!overlaps(f, room)) {
+                    continue;
+                }
+                remove(slot);
+                if (room.i > f.i) {
+                    split.push_back({f.i, f.j, room.i - f.i, f.width});
+                }
+                if (room.i + room.height < f.i + f.height) {
+                    split.push_back({room.i + room.height, f.j, f.i + f.height - room.i - room.height, f.width});
+                }
+                if (room.j > f.j) {
+                    split.push_back({f.i, f.j, f.height, room.j - f.j});
+                }
+                if (room.j + room.width < f.j + f.width) {
+                    split.push_back({f.i, room.j + room.width, f.height, f.j + f.width - room.j - room.width});
+                }
+            }
+
+            for (size_t k = 0; k < split.size(); k++) {
+                auto &rect = split[k];
+                if (rect.height < room_base || rect.width < room_base) {
+                    continue;
+                }
+                bool covered = false;
+                for (size_t o = 0; o < split.size() && !covered; o++) {
+                    covered = o != k && contains(split[o], rect) && (!contains(rect, split[o]) || o < k);
+                }
+                if (!covered) {
+                    query(rect, hit);
+                    for (auto slot: hit) {
+                        if (contains(rects[slot], rect)) {
+                            covered = true;
+                            break;
+                        }
+                    }
+                }
+                if (!covered) {
+                    insert(rect);
+                }
+            }
+        }
+
+    private:
+        static constexpr int BIN = 16;
+
+        int n_i = 0;
+        int n_j = 0;
+        int room_base = 0;
+        int room_radix = 0;
+        int bins_i = 0;
+        int bins_j = 0;
+        int capacity = 0;
+        std::vector<Rect> rects;
+        std::vector<char> alive;
+        std::vector<int> free_slots;
+        std::vector<std::vector<int>> bins;
+        std::vector<std::vector<long long>> weights;
+        std::vector<int> stamp;
+        int query_stamp = 0;
+        std::vector<int> heights;
+        std::vector<int> free_above;
+        std::vector<std::pair<int, int>> stack;
+        std::vector<int> hit;
+        std::vector<Rect> split;
+
+        static bool overlaps(const Rect &a, const Rect &b) {
+            return a.i < b.i + b.height && b.i < a.i + a.height
+                   && a.j < b.j + b.width && b.j < a.j + a.width;
+        }
+
+        static bool contains(const Rect &a, const Rect &b) {
+            return a.i <= b.i && a.j <= b.j
+                   && a.i + a.height >= b.i + b.height
+                   && a.j + a.width >= b.j + b.width;
+        }
+
+        static int highest_bit(int n) {
+            int bit = 1;
+            while (bit * 2 <= n) {
+                bit *= 2;
+            }
+            return bit;
+        }
+
+        int size_class(int height, int width) const {
+            return (height - room_base) * room_radix + (width - room_base);
+        }
+
+        long long fits(const Rect &rect, int size) const {
+            auto height = size / room_radix + room_base;
+            auto width = size % room_radix + room_base;
+            if (rect.height < height || rect.width < width) {
+                return 0;
+            }
+            return (long long) (rect.height - height + 1) * (rect.width - width + 1);
+        }
+
+        static long long sum(const std::vector<long long> &tree, int slot) {
+            long long total = 0;
+            for (; slot > 0; slot -= slot & -slot) {
+                total += tree[slot];
+            }
+            return total;
+        }
+
+        void add(std::vector<long long> &tree, int slot, long long value) {
+            for (slot++; slot <= capacity; slot += slot & -slot) {
+                tree[slot] += value;
+            }
+        }
+
+        void grow() {
+            auto old_capacity = capacity;
+            capacity = std::max(64, capacity * 2);
+            rects.resize(capacity);
+            alive.resize(capacity, 0);
+            stamp.resize(capacity, 0);
+            for (size_t size = 0; size < weights.size(); size++) {
+                weights[size].assign(capacity + 1, 0);
+                if (size >= size_t(room_radix * room_radix)) {
+                    continue;
+                }
+                for (int slot = 0; slot < capacity; slot++) {
+                    if (alive[slot]) {
+                        add(weights[size], slot, fits(rects[slot], size));
+                    }
+                }
+            }
+            for (int slot = capacity - 1; slot >= old_capacity; slot--) {
+                free_slots.push_back(slot);
+            }
+        }
+
+        void insert(const Rect &rect) {
+            if (free_slots.empty()) {
+                grow();
+            }
+            auto slot = free_slots.back();
+            free_slots.pop_back();
+            rects[slot] = rect;
+            alive[slot] = 1;
+            for (size_t size = 0; size < size_t(room_radix * room_radix); size++) {
+                add(weights[size], slot, fits(rect, size));
+            }
+            for (int bi = rect.i / BIN; bi <= (rect.i + rect.height - 1) / BIN; bi++) {
+                for (int bj = rect.j / BIN; bj <= (rect.j + rect.width - 1) / BIN; bj++) {
+                    bins[bi * bins_j + bj].push_back(slot);
+                }
+            }
+        }
+
+        //bins keep stale slots until the next query through them
+        void remove(int slot) {
+            alive[slot] = 0;
+            for (size_t size = 0; size < size_t(room_radix * room_radix); size++) {
+                add(weights[size], slot, -fits(rects[slot], size));
+            }
+            free_slots.push_back(slot);
+        }
+
+        void query(const Rect &area, std::vector<int> &out) {
+            out.clear();
+            query_stamp++;
+            for (int bi = area.i / BIN; bi <= (area.i + area.height - 1) / BIN; bi++) {
+                for (int bj = area.j / BIN; bj <= (area.j + area.width - 1) / BIN; bj++) {
+                    auto &bin = bins[bi * bins_j + bj];
+                    Rect bounds{bi * BIN, bj * BIN, BIN, BIN};
+                    bin.erase(std::remove_if(bin.begin(), bin.end(), [&](int slot) {
+                        return !alive[slot] || !overlaps(rects[slot], bounds);
+                    }), bin.end());
+                    for (auto slot: bin) {
+                        if (stamp[slot] != query_stamp) {
+                            stamp[slot] = query_stamp;
+                            out.push_back(slot);
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+public:
+    //index of the lowest set bit of a non-zero word
+    static int ctz64(uint64_t word) {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanForward64(&index, word);
+        return int(index);
+#else
+        return __builtin_ctzll(word);
+#endif
+    }
+
+    //first position from c on whose bit equals value, words * 64 when there is none
+    static int scan_bits(const uint64_t *bits, int words, int c, bool value) {
+        auto flip = value ? uint64_t(0) : ~uint64_t(0);
+        auto w = c >> 6;
+        if (w >= words) {
+            return words * 64;
+        }
+        auto word = (bits[w] ^ flip) & (~uint64_t(0) << (c & 63));
+        while (!word) {
+            if (++w == words) {
+                return words * 64;
+            }
+            word = bits[w] ^ flip;
+        }
+        return w * 64 + ctz64(word);
+    }
+
+private:
+    //one bit per cell, rows padded to whole words so neighbouring columns can be read with word shifts
+    class BitGrid {
+    public:
+        void assign(int n_rows, int n_cols) {
+            rows = n_rows;
+            cols = n_cols;
+            words = (n_cols + 63) / 64 + 1;
+            bits.assign(rows * words, 0);
+        }
+
+        bool get(int r, int c) const {
+            if (r < 0 || r >= rows || c < 0 || c >= cols) {
+                return false;
+            }
+            return (bits[r * words + (c >> 6)] >> (c & 63)) & 1;
+        }
+
+        void set(int r, int c, bool value) {
+            auto &word = bits[r * words + (c >> 6)];
+            auto bit = uint64_t(1) << (c & 63);
+            word = value ? word | bit : word & ~bit;
+        }
+
+        //fills codes[c] with the 8-neighbour code of every cell in row r, 64 columns per step
+        void neighbour_codes(int r, std::vector<uint8_t> &codes) const {
+            codes.resize(words * 64);
+            for (int w = 0; w + 1 < words; w++) {
+                auto up = shifted(r - 1, w);
+                auto mid = shifted(r, w);
+                auto down = shifted(r + 1, w);
+                uint64_t planes[8] = {up[1], up[2], mid[2], down[2], down[1], down[0], mid[0], up[0]};
+
+                for (int byte = 0; byte < 8; byte++) {
+                    uint64_t lanes = 0;
+                    for (int n = 0; n < 8; n++) {
+                        lanes |= SPREAD()[(planes[n] >> (byte * 8)) & 0xff] << n;
+                    }
+                    for (int k = 0; k < 8; k++) {
+                        codes[w * 64 + byte * 8 + k] = uint8_t(lanes >> (k * 8));
+                    }
+                }
+            }
+        }
+
+        //8-neighbour code of a single cell, same bit order as neighbour_codes
+        uint8_t neighbour_code(int r, int c) const {
+            return get(r - 1, c)
+                   | get(r - 1, c + 1) << 1
+                   | get(r, c + 1) << 2
+                   | get(r + 1, c + 1) << 3
+                   | get(r + 1, c) << 4
+                   | get(r + 1, c - 1) << 5
+                   | get(r, c - 1) << 6
+                   | get(r - 1, c - 1) << 7;
+        }
+
+    private:
+        int rows = 0;
+        int cols = 0;
+        int words = 0;
+        std::vector<uint64_t> bits;
+
+        //word w of row r with its west and east neighbour columns aligned onto the same bit
+        std::array<uint64_t, 3> shifted(int r, int w) const {
+            if (r < 0 || r >= rows) {
+                return {0, 0, 0};
+            }
+            auto row = &bits[r * words];
+            auto prev = w > 0 ? row[w - 1] : 0;
+            return {(row[w] << 1) | (prev >> 63), row[w], (row[w] >> 1) | (row[w + 1] << 63)};
+        }
+
+        //spreads the 8 bits of a byte into the low bit of 8 byte lanes
+        static const std::array<uint64_t, 256> &SPREAD() {
+            static const auto table = [] {
+                std::array<uint64_t, 256> spread{};
+                for (int b = 0; b < 256; b++) {
+                    for (int k = 0; k < 8; k++) {
+                        if (b & (1 << k)) {
+                            spread[b] |= uint64_t(1) << (k * 8);
+                        }
+                    }
+                }
+                return spread;
+            }();
+            return table;
+        }
+    };
+
+    //open addressing set of integer keys, clear() keeps the table for the next generation
+    class KeySet {
+    public:
+        void clear() {
+            std::fill(slots.begin(), slots.end(), EMPTY);
+            count = 0;
+        }
+
+        void reserve(size_t n) {
+            if (n * 2 > slots.size()) {
+                rehash(n * 2);
+            }
+        }
+
+        bool insert(uint64_t key) {
+            if ((count + 1) * 2 > slots.size()) {
+                rehash(slots.size() * 2);
+            }
+            auto mask = slots.size() - 1;
+            for (auto slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+                if (slots[slot] == key) {
+                    return false;
+                }
+                if (slots[slot] == EMPTY) {
+                    slots[slot] = key;
+                    count++;
+                    return true;
+                }
+            }
+        }
+
+        bool contains(uint64_t key) const {
+            if (slots.empty()) {
+                return false;
+            }
+            auto mask = slots.size() - 1;
+            for (auto slot = hash(key) & mask; slots[slot] != EMPTY; slot = (slot + 1) & mask) {
+                if (slots[slot] == key) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+    private:
+        static constexpr uint64_t EMPTY = ~uint64_t(0);
+        std::vector<uint64_t> slots;
+        size_t count = 0;
+
+        static size_t hash(uint64_t key) {
+            key ^= key >> 33;
+            key *= 0xff51afd7ed558ccdULL;
+            key ^= key >> 33;
+            return key;
+        }
+
+        void rehash(size_t size) {
+            size_t capacity = 16;
+            while (capacity < size) {
+                capacity *= 2;
+            }
+            std::vector<uint64_t> old(capacity, EMPTY);
+            old.swap(slots);
+            count = 0;
+            for (auto key: old) {
+                if (key != EMPTY) {
+                    insert(key);
+                }
+            }
+        }
     };
 
+    //FIFO of nodes for tunnel(), storage is reused once it drains
+    class TunnelQueue {
+    public:
+        using Node = std::tuple<int, int, std::string>;
+
+        void push(Node node) {
+            nodes.push_back(std::move(node));
+        }
+
+        Node pop() {
+            auto node = std::move(nodes[head++]);
+            if (head == nodes.size()) {
+                clear();
+            }
+            return node;
+        }
+
+        bool empty() const {
+            return head == nodes.size();
+        }
+
+        void clear() {
+            nodes.clear();
+            head = 0;
+        }
+
+    private:
+        std::vector<Node> nodes;
+        size_t head = 0;
+    };
+
+    //STAIR_END and CLOSE_END compiled into lookups over the 8-neighbour openspace code
+    struct EndPattern {
+        std::vector<std::pair<int, int>> corridor;
+        std::vector<std::pair<int, int>> close;
+        std::vector<std::pair<int, int>> open;
+        std::vector<std::pair<int, int>> recurse;
+        std::pair<int, int> next;
+    };
+
+    struct EndTable {
+        std::vector<EndPattern> patterns;
+        std::array<uint8_t, 256> match{}; //bit k set when patterns[k] holds for the code
+    };
+
+    static int neighbour_bit(int dr, int dc) {
+        static const int bits[3][3] = {{7, 0, 1},
+                                       {6, -1, 2},
+                                       {5, 4, 3}};
+        if (dr < -1 || dr > 1 || dc < -1 || dc > 1) {
+            return -1;
+        }
+        return bits[dr + 1][dc + 1];
+    }
+
+    static EndTable compile_ends(const std::map<std::string, std::map<std::string, std::vector<std::vector<int>>>> &ends) {
+        EndTable table;
+        auto offsets = [](const std::map<std::string, std::vector<std::vector<int>>> &check, const std::string &key) {
+            std::vector<std::pair<int, int>> list;
+            auto it = check.find(key);
+            if (it != check.end()) {
+                for (const auto &p: it->second) {
+                    list.emplace_back(p[0], p[1]);
+                }
+            }
+            return list;
+        };
+        for (const auto &[dir, check]: ends) {
+            auto k = table.patterns.size();
+            auto next = offsets(check, "next");
+            EndPattern pattern{offsets(check, "corridor"), offsets(check, "close"), offsets(check, "open"),
+                               offsets(check, "recurse"), next.empty() ? std::pair<int, int>() : next.front()};
+
+            //corridor cells inside the neighbourhood must be open, walled ones must not be
+            int required = 0;
+            int walled = 0;
+            for (auto [dr, dc]: pattern.corridor) {
+                if (auto bit = neighbour_bit(dr, dc); bit >= 0) {
+                    required |= 1 << bit;
+                }
+            }
+            for (auto [dr, dc]: offsets(check, "walled")) {
+                walled |= 1 << neighbour_bit(dr, dc);
+            }
+            for (int code = 0; code < 256; code++) {
+                if ((code & required) == required && !(code & walled)) {
+                    table.match[code] |= 1 << k;
+                }
+            }
+            table.patterns.push_back(std::move(pattern));
+        }
+        return table;
+    }
+
+    static const EndTable &STAIR_TABLE() {
+        static const EndTable table = compile_ends(STAIR_END);
+        return table;
+    }
+
+    static const EndTable &CLOSE_TABLE() {
+        static const EndTable table = compile_ends(CLOSE_END);
+        return table;
+    }
+
+public:
     class Dungeon {
-        friend Dungeon rdg<T>::create_dungeon(Options options);
+        friend Dungeon rdg<T>::create_dungeon(Options options, unsigned seed);
+        friend class rdg;
+        friend class Generator;
+
+    public:
+        const Options &getOptions() const {
+            return options;
+        }
+
+        const auto &getCells() const {
+            return cells;
+        }
+
+        const auto &getStairs() const {
+            return stairs;
+        }
+
+        const auto &getRooms() const {
+            return rooms;
+        }
+
+        const auto &getDoors() const {
+            return doors;
+        }
+
+        //heap allocations made while generating the current dungeon, 0 unless RDG_COUNT_ALLOCATIONS is defined
+        size_t getAllocations() const {
+            return allocations;
+        }
+
+        //changes one cell through f(Cell &), journaling the change when recording
+        template<typename F>
+        void edit(int r, int c, F f) {
+            auto &cell = cells[r][c];
+            auto before = cell.getFlags();
+            f(cell);
+            if (journaling && cell.getFlags() != before) {
+                journal.record(index(r, c), before, cell.getFlags());
+            }
+        }
+
+        uint32_t index(int r, int c) const {
+            return uint32_t(r * cells.stride() + c);
+        }
+
+        Journal &getJournal() {
+            return journal;
+        }
+
+        const Journal &getJournal() const {
+            return journal;
+        }
+
+        bool isJournaling() const {
+            return journaling;
+        }
+
+        void setJournaling(bool journaling) {
+            this->journaling = journaling;
+        }
+
+        //generates a new dungeon in place, reusing every buffer the new size fits into
+        void reset(Options _options, unsigned seed) {
+            configure(std::move(_options), seed);
+            for (auto phase = INIT_CELLS; phase != DONE; phase = static_cast<Phase>(phase + 1)) {
+                run_phase(phase);
+            }
+        }
+
+    private:
+        Options options;
+        Grid cells;
+        std::vector<Room> rooms; //room id - 1
+        std::vector<Stairs> stairs;
+        std::vector<Door> doors;
+        std::vector<std::pair<int, Door>> opened; //room id and door, in the order open_rooms placed them
+
+        int n_i;
+        int n_j;
+        int n_rows;
+        int n_cols;
+        int max_row;
+        int max_col;
+        int room_base;
+        int room_radix;
+        int n_rooms = 0;
+        int last_room_id = 0;
+        unsigned seed = 0;
+        Rng rng;
+        BitGrid open_bits;
+        BitGrid corridor_bits;
+
+        //set by Generator, long loops stop at the next check once it is cancelled or past the deadline
+        struct Budget {
+            const std::atomic<bool> *cancelled = nullptr;
+            std::chrono::steady_clock::time_point deadline;
+            int countdown = 0;
+        } budget;
+        static constexpr int YIELD_INTERVAL = 256;
+        int cursor = 0; //next iteration of the paused loop of the current phase
+        size_t allocations = 0;
+        Journal journal;
+        bool journaling = false;
+        std::vector<uint32_t> journaled; //flags as of the last journaled phase
+
+        //scratch space kept across reset()
+        TunnelQueue tunnels;
+        std::vector<Sill> sills;
+        KeySet connected;
+        FreeRects free_rects;
+        std::vector<std::pair<int, int>> sizes;
+        std::vector<Stairs> ends;
+        std::vector<uint8_t> codes;
+        KeySet door_cells;
+        std::vector<int> door_counts;
+        std::vector<uint8_t> nodes;
+        std::vector<int> room_buckets;
+        std::vector<int> next_in_bucket;
+
+        Dungeon(Options
+                _options, unsigned seed) {
+            configure(std::move(_options), seed);
+        }
+
+        void configure(Options _options, unsigned seed) {
+            options = std::move(_options);
+            n_i = options.n_rows / 2;
+            n_j = options.n_cols / 2;
+            n_rows = n_i * 2;
+            n_cols = n_j * 2;
+            max_row = n_rows - 1;
+            max_col = n_cols - 1;
+            room_base = (options.room_min + 1) / 2;
+            room_radix = ((options.room_max - options.room_min) / 2) + 1;
+            n_rooms = 0;
+            last_room_id = 0;
+            this->seed = seed;
+            rng.seed(seed);
+            budget = {};
+            cursor = 0;
+            allocations = 0;
+            journal.clear();
+            journaling = options.journal;
+            rooms.clear();
+            stairs.clear();
+            doors.clear();
+            opened.clear();
+            tunnels.clear();
+        }
+
+        template<typename N>
+        N rand(N n) {
+            return random(rng, n);
+        }
+
+        //the rooms placed so far and a corridor skeleton between them: each room after the first is joined
+        //by an elbow to the nearest earlier room in the buckets around it, else to the room placed before it,
+        //so the rooms form one tree; elbows are turned by their own generator to leave rng, and with it the
+        //rest of the generation, as it was
+        void sketch(Preview &preview, int scale) {
+            nodes.assign(size_t(n_i) * n_j, Preview::EMPTY);
+            for (int i = 0; i < n_i; i++) {
+                for (int j = 0; j < n_j; j++) {
+                    const auto &cell = cells[i * 2 + 1][j * 2 + 1];
+                    if (cell.hasType(ROOM)) {
+                        nodes[size_t(i) * n_j + j] = Preview::ROOM;
+                    } else if (cell.hasType(BLOCKED)) {
+                        nodes[size_t(i) * n_j + j] = Preview::BLOCKED;
+                    }
+                }
+            }
+
+            auto bucket_size = 2 * (room_base + room_radix);
+            auto buckets_i = n_i / bucket_size + 1;
+            auto buckets_j = n_j / bucket_size + 1;
+            room_buckets.assign(size_t(buckets_i) * buckets_j, -1);
+            next_in_bucket.assign(rooms.size(), -1);
+            auto center = [&](int k) {
+                const auto &room = rooms[k];
+                return std::pair<int, int>(((room.north - 1) / 2 + (room.south - 1) / 2) / 2,
+                                           ((room.west - 1) / 2 + (room.east - 1) / 2) / 2);
+            };
+            std::minstd_rand elbows(seed);
+            for (int k = 0; k < int(rooms.size()); k++) {
+                auto [i, j] = center(k);
+                auto bi = i / bucket_size;
+                auto bj = j / bucket_size;
+                if (k > 0) {
+                    auto nearest = k - 1;
+                    auto best = INT_MAX;
+                    for (auto b_i = std::max(bi - 1, 0); b_i <= std::min(bi + 1, buckets_i - 1); b_i++) {
+                        for (auto b_j = std::max(bj - 1, 0); b_j <= std::min(bj + 1, buckets_j - 1); b_j++) {
+                            for (auto other = room_buckets[size_t(b_i) * buckets_j + b_j]; other >= 0;
+                                 other = next_in_bucket[other]) {
+                                auto [oi, oj] = center(other);
+                                auto distance = std::abs(oi - i) + std::abs(oj - j);
+                                if (distance < best || (distance == best && other < nearest)) {
+                                    best = distance;
+                                    nearest = other;
+                                }
+                            }
+                        }
+                    }
+                    auto [ni, nj] = center(nearest);
+                    auto corner_i = elbows() & 1 ? i : ni;
+                    auto corner_j = corner_i == i ? nj : j;
+                    sketch_line(i, j, corner_i, corner_j);
+                    sketch_line(corner_i, corner_j, ni, nj);
+                }
+                auto &bucket = room_buckets[size_t(bi) * buckets_j + bj];
+                next_in_bucket[k] = bucket;
+                bucket = k;
+            }
+
+            preview.scale = std::max(scale, 1);
+            preview.rows = (n_i + preview.scale - 1) / preview.scale;
+            preview.cols = (n_j + preview.scale - 1) / preview.scale;
+            preview.pixels.assign(size_t(preview.rows) * preview.cols, Preview::EMPTY);
+            for (int i = 0; i < n_i; i++) {
+                auto *row = &preview.pixels[size_t(i / preview.scale) * preview.cols];
+                for (int j = 0; j < n_j; j++) {
+                    auto &pixel = row[j / preview.scale];
+                    pixel = std::max(pixel, nodes[size_t(i) * n_j + j]);
+                }
+            }
+        }
 
-    public:
-        const auto &getCells() {
-            return cells;
+        //marks the empty nodes of a horizontal or vertical run as corridor
+        void sketch_line(int i1, int j1, int i2, int j2) {
+            for (auto i = std::min(i1, i2); i <= std::max(i1, i2); i++) {
+                for (auto j = std::min(j1, j2); j <= std::max(j1, j2); j++) {
+                    auto &node = nodes[size_t(i) * n_j + j];
+                    if (node == Preview::EMPTY) {
+                        node = Preview::CORRIDOR;
+                    }
+                }
+            }
         }
 
-        const auto &getStairs() {
-            return stairs;
+        int rand(int from, int to) {
+            return from + random(rng, to - from + 1);
         }
 
-        const auto &getRooms() {
-            return rooms;
+        bool yield() {
+            if (!budget.cancelled || --budget.countdown > 0) {
+                return false;
+            }
+            budget.countdown = YIELD_INTERVAL;
+            return budget.cancelled->load(std::memory_order_relaxed)
+                   || std::chrono::steady_clock::now() >= budget.deadline;
         }
 
-        const auto &getDoors() {
-            return doors;
+        //returns false when the phase paused and has to be run again to finish
+        bool run_phase(Phase phase) {
+            auto before = allocation_count();
+            auto done = step_phase(phase);
+            if (done && journaling && options.journal) {
+                journal_phase(phase);
+            }
+            allocations += allocation_count() - before;
+            return done;
         }
 
-    private:
-        const Options options;
-        std::vector<std::vector<Cell>> cells;
-        std::map<int, Room> rooms;
-        std::list<Stairs> stairs;
-        std::list<std::list<Door>> doors;
-
-        const int n_i;
-        const int n_j;
-        const int n_rows;
-        const int n_cols;
-        const int max_row;
-        const int max_col;
-        const int room_base;
-        const int room_radix;
-        int n_rooms = 0;
-        int last_room_id = 0;
+        //generation writes cells directly, so each finished phase is diffed against the previous one
+        void journal_phase(Phase phase) {
+            auto n = cells.size() * cells.stride();
+            if (phase == INIT_CELLS) {
+                journaled.assign(n, 0);
+            }
+            for (auto r = 0; r <= n_rows; r++) {
+                for (auto c = 0; c <= n_cols; c++) {
+                    auto k = index(r, c);
+                    auto flags = cells[r][c].getFlags();
+                    if (flags != journaled[k]) {
+                        journal.record(k, journaled[k], flags);
+                        journaled[k] = flags;
+                    }
+                }
+            }
+        }
 
-        explicit Dungeon(Options
-                         _options) :
-                options(std::move(_options)),
-                n_i(options.n_rows / 2),
-                n_j(options.n_cols / 2),
-                n_rows(n_i * 2),
-                n_cols(n_j * 2),
-                max_row(n_rows - 1),
-                max_col(n_cols - 1),
-                room_base((options.room_min + 1) / 2),
-                room_radix(((options.room_max - options.room_min) / 2) + 1) {}
+        bool step_phase(Phase phase) {
+            switch (phase) {
+                case INIT_CELLS:
+                    init_cells();
+                    return true;
+                case EMPLACE_ROOMS:
+                    return emplace_rooms();
+                case OPEN_ROOMS:
+                    open_rooms();
+                    return true;
+                case LABEL_ROOMS:
+                    label_rooms();
+                    return true;
+                case CORRIDORS:
+                    return corridors();
+                case EMPLACE_STAIRS:
+                    if (options.add_stairs) {
+                        emplace_stairs();
+                    }
+                    return true;
+                case CLEAN_DUNGEON:
+                    return clean_dungeon();
+                default:
+                    return true;
+            }
+        }
 
         void init_cells() {
-            for (int r = 0; r <= n_rows; r++) {
-                cells.emplace_back();
-                for (int c = 0; c <= n_cols; c++) {
-                    cells[r].emplace_back();
-                }
-            }
+            cells.assign(n_rows + 1, n_cols + 1);
 
             auto mask = DUNGEON_LAYOUT.find(options.dungeon_layout);
             if (mask != DUNGEON_LAYOUT.end()) {
@@ -264,7 +1438,7 @@ public:
             }
         }
 
-        void mask_cells(std::vector<std::vector<int>> mask) {
+        void mask_cells(const std::vector<std::vector<int>> &mask) {
             double r_x = mask.size() * 1.0 / (n_rows + 1);
             double c_x = mask[0].size() * 1.0 / (n_cols + 1);
 
@@ -292,12 +1466,15 @@ public:
             }
         }
 
-        void emplace_rooms() {
+        bool emplace_rooms() {
             if (options.room_layout == "Packed") {
                 pack_rooms();
+            } else if (options.room_layout == "Fitted") {
+                fit_rooms();
             } else {
-                scatter_rooms();
+                return scatter_rooms();
             }
+            return true;
         }
 
         void pack_rooms() {
@@ -309,7 +1486,7 @@ public:
                     if (cells[r][c].hasType(ROOM)) {
                         continue;
                     }
-                    if ((i == 0 || j == 0) && vstd::rand(0, 1)) {
+                    if ((i == 0 || j == 0) && rand(0, 1)) {
                         continue;
                     }
 
@@ -319,10 +1496,6 @@ public:
         }
 
         void emplace_room(int _i = -1, int _j = -1, int _height = -1, int _width = -1) {
-            if (n_rooms == 999) {
-                return;
-            }
-
             auto [i, j, height, width] = set_room(_i, _j, _height, _width);
 
             int r1 = i * 2 + 1;
@@ -343,7 +1516,7 @@ public:
                 return;
             }
 
-            if (!hit.empty()) {
+            if (hit) {
                 return;
             }
 
@@ -367,7 +1540,7 @@ public:
             int h = (r2 - r1) + 1;
             int w = (c2 - c1) + 1;
             Room _room = {room_id, r1, c1, r1, r2, c1, c2, h, w, h * w};
-            rooms[room_id] = _room;
+            rooms.push_back(_room);
 
             for (int r = r1 - 1; r <= r2 + 1; r++) {
                 if (!(cells[r][c1 - 1].hasType(ROOM)
@@ -394,56 +1567,96 @@ public:
         std::tuple<int, int, int, int> set_room(int _i, int _j, int height, int width) {
             if (height < 0) {
                 if (_i < 0) {
-                    height = vstd::rand(room_radix) + room_base;
+                    height = rand(room_radix) + room_base;
                 } else {
                     int a = n_i - room_base - _i;
                     a = a < 0 ? 0 : a;
                     auto r = (a < room_radix) ? a : room_radix;
 
-                    height = vstd::rand(r) + room_base;
+                    height = rand(r) + room_base;
                 }
             }
             if (width < 0) {
                 if (_j < 0) {
-                    width = vstd::rand(room_radix) + room_base;
+                    width = rand(room_radix) + room_base;
                 } else {
                     int a = n_j - room_base - _j;
                     a = a < 0 ? 0 : a;
                     auto r = (a < room_radix) ? a : room_radix;
 
-                    width = vstd::rand(r) + room_base;
+                    width = rand(r) + room_base;
                 }
             }
 
-            return std::make_tuple(_i < 0 ? vstd::rand(n_i - height) : _i,
-                                   _j < 0 ? vstd::rand(n_j - width) : _j,
+            return std::make_tuple(_i < 0 ? rand(n_i - height) : _i,
+                                   _j < 0 ? rand(n_j - width) : _j,
                                    height,
                                    width);
         }
 
-        std::tuple<std::map<int, int>, bool> sound_room(int r1, int c1, int r2, int c2) {
-            std::map<int, int> hit;
+        //whether the area overlaps a room, and whether it touches a blocked cell
+        std::tuple<bool, bool> sound_room(int r1, int c1, int r2, int c2) {
+            bool hit = false;
             for (int r = r1; r <= r2; r++) {
                 for (int c = c1; c <= c2; c++) {
                     if (cells[r][c].hasType(BLOCKED)) {
                         return std::make_tuple(hit, true);
                     }
-                    if (cells[r][c].hasType(ROOM)) {
-                        auto id = cells[r][c].getRoomId();
-                        if (!vstd::ctn(hit, id)) {
-                            hit[id] = 0;
-                        }
-                        hit[id] = hit[id] + 1;
-                    }
+                    hit = hit || cells[r][c].hasType(ROOM);
                 }
             }
             return std::make_tuple(hit, false);
         }
 
-        void scatter_rooms() {
-            for (int i = 0; i < alloc_rooms(); i++) {
+        bool scatter_rooms() {
+            for (; cursor < alloc_rooms(); cursor++) {
+                if (yield()) {
+                    return false;
+                }
                 emplace_room();
             }
+            cursor = 0;
+            return true;
+        }
+
+        //samples only positions a room of the chosen size fits into, so every attempt places a room
+        //or rules its size out for the rest of the pass
+        void fit_rooms() {
+            free_rects.reset(n_i, n_j, room_base, room_radix);
+            free_rects.init([this](int i, int j) {
+                for (int r = i * 2 + 1; r <= std::min(i * 2 + 2, n_rows); r++) {
+                    for (int c = j * 2 + 1; c <= std::min(j * 2 + 2, n_cols); c++) {
+                        if (cells[r][c].hasType(BLOCKED)) {
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            });
+
+            sizes.clear();
+            for (int height = room_base; height < room_base + room_radix; height++) {
+                for (int width = room_base; width < room_base + room_radix; width++) {
+                    sizes.emplace_back(height, width);
+                }
+            }
+
+            for (int placed = 0; placed < alloc_rooms() && !sizes.empty();) {
+                auto size = rand(sizes.size());
+                auto [height, width] = sizes[size];
+                auto room = free_rects.sample(height, width, rng);
+                if (!room) {
+                    sizes.erase(sizes.begin() + size);
+                    continue;
+                }
+                auto before = n_rooms;
+                emplace_room(room->i, room->j, height, width);
+                if (n_rooms == before) {
+                    return;
+                }
+                free_rects.place(*room);
+                placed++;
+            }
         }
 
         int alloc_rooms() {
@@ -452,22 +1665,20 @@ public:
             return dungeon_area / room_area;
         }
 
-        void open_room(Room &room, std::set<std::pair<int, int>> &connected) {
-            auto list = door_sills(room);
-            if (list.empty()) {
+        void open_room(Room &room) {
+            door_sills(room);
+            if (sills.empty()) {
                 return;
             }
             auto n_opens = alloc_opens(room);
 
-            for (int i = 0; i < n_opens && !list.empty(); i++) {
-                std::list<Sill> sills;
-                auto it = list.begin();
-                std::advance(it, vstd::rand(list.size() - 1));
-                sills.splice(sills.begin(), list, it);
-                auto sill = sills.front();
+            for (int i = 0; i < n_opens && !sills.empty(); i++) {
+                auto it = sills.begin() + rand(sills.size() - 1);
+                auto sill = std::move(*it);
+                sills.erase(it);
                 auto door_r = sill.door_r;
                 auto door_c = sill.door_c;
-                auto door_cell = cells[door_r][door_c];
+                auto &door_cell = cells[door_r][door_c];
 
                 if (door_cell.isDoorspace()) {
                     n_opens--;
@@ -476,22 +1687,20 @@ public:
 
                 auto out_id = sill.out_id;
                 if (out_id) {
-                    auto connect = std::make_pair(std::min(room.id, out_id), std::max(room.id, out_id));
+                    auto connect = uint64_t(std::min(room.id, out_id)) << 32 | uint64_t(std::max(room.id, out_id));
 
-                    if (vstd::ctn(connected, connect)) {
+                    if (!connected.insert(connect)) {
                         n_opens--;
                         continue;
                     }
-
-                    connected.insert(connect);
                 }
                 auto open_r = sill.sill_r;
                 auto open_c = sill.sill_c;
                 auto open_dir = sill.dir;
 
                 for (auto x = 0; x < 3; x++) {
-                    auto r = open_r + (DI[open_dir] * x);
-                    auto c = open_c + (DJ[open_dir] * x);
+                    auto r = open_r + (DI.at(open_dir) * x);
+                    auto c = open_c + (DJ.at(open_dir) * x);
 
                     cells[r][c].removeType(PERIMETER);
                     cells[r][c].addType(ENTRANCE);
@@ -534,14 +1743,13 @@ public:
                 }
 
                 door.out_id = out_id;
-                if (out_id) {
-                    room.door.insert({open_dir, door});
-                }
+                door.dir = open_dir;
+                opened.emplace_back(room.id, std::move(door));
             }
         }
 
         int generate_door_type() {
-            auto i = int(vstd::rand(110));
+            auto i = int(rand(110));
 
             if (i < 15) {
                 return ARCH;
@@ -562,136 +1770,278 @@ public:
             auto room_h = ((room.south - room.north) / 2) + 1;
             auto room_w = ((room.east - room.west) / 2) + 1;
             auto flumph = sqrt(room_w * room_h);
-            return (int) flumph + vstd::rand(flumph);
+            return (int) flumph + rand(flumph);
         }
 
         std::optional<Sill> check_sill(const Room &room, int sill_r, int sill_c, const std::string &dir) {
-            auto door_r = sill_r + DI[dir];
-            auto door_c = sill_c + DJ[dir];
-            auto door_cell = cells[door_r][door_c];
+            auto door_r = sill_r + DI.at(dir);
+            auto door_c = sill_c + DJ.at(dir);
+            auto &door_cell = cells[door_r][door_c];
             if (!(door_cell.hasType(PERIMETER))) {
                 return {};
             }
             if (door_cell.isBlockedDoor()) {
                 return {};
             }
-            auto out_r = door_r + DI[dir];
-            auto out_c = door_c + DJ[dir];
-            auto out_cell = cells[out_r][out_c];
+            auto out_r = door_r + DI.at(dir);
+            auto out_c = door_c + DJ.at(dir);
+            auto &out_cell = cells[out_r][out_c];
             if (out_cell.hasType(BLOCKED)) {
                 return {};
             }
-            auto out_id = -1;
+            auto out_id = 0;
             if (out_cell.hasType(ROOM)) {
                 out_id = out_cell.getRoomId();
             }
             return std::make_optional<Sill>({sill_r, sill_c, dir, door_r, door_c, out_id});
         }
 
-        std::list<Sill> door_sills(const Room &room) {
-            std::list<Sill> sills;
+        //fills sills with every usable door position of the room
+        void door_sills(const Room &room) {
+            sills.clear();
             if (room.north >= 3) {
                 for (int c = room.west; c <= room.east; c += 2) {
                     if (auto sill = check_sill(room, room.north, c, "north")) {
-                        sills.push_back(sill.value());
+                        sills.push_back(std::move(*sill));
                     }
                 }
             }
             if (room.south <= n_rows - 3) {
                 for (int c = room.west; c <= room.east; c += 2) {
                     if (auto sill = check_sill(room, room.south, c, "south")) {
-                        sills.push_back(sill.value());
+                        sills.push_back(std::move(*sill));
                     }
                 }
             }
             if (room.west >= 3) {
                 for (int r = room.north; r <= room.south; r += 2) {
                     if (auto sill = check_sill(room, r, room.west, "west")) {
-                        sills.push_back(sill.value());
+                        sills.push_back(std::move(*sill));
                     }
                 }
             }
             if (room.east <= n_cols - 3) {
                 for (int r = room.north; r <= room.south; r += 2) {
                     if (auto sill = check_sill(room, r, room.east, "east")) {
-                        sills.push_back(sill.value());
+                        sills.push_back(std::move(*sill));
                     }
                 }
             }
-            return sills;
         }
 
         void open_rooms() {
-            std::set<std::pair<int, int>> connected;
-            for (int i = 1; i <= n_rooms; i++) {
-                open_room(rooms[i], connected);
+            connected.clear();
+            for (auto &room: rooms) {
+                open_room(room);
             }
         }
 
+        //the id is kept with the room and drawn from there, no cell carries it
         void label_rooms() {
-            for (auto id = 1; id <= n_rooms; id++) {
-                auto _room = rooms[id];
-                auto label = vstd::str(_room.id);
-                auto len = label.length();
-                auto label_r = int((_room.north + _room.south) / 2);
-                auto label_c = int((_room.west + _room.east - len) / 2) + 1;
+            for (auto &_room: rooms) {
+                char label[16];
+                auto len = int(std::to_chars(label, label + sizeof(label), _room.id).ptr - label);
+                _room.label_row = (_room.north + _room.south) / 2;
+                //ids wider than the room overhang it, but never the grid's n_cols + 1 columns
+                _room.label_col = std::clamp((_room.west + _room.east - len) / 2 + 1, 0, std::max(0, n_cols + 1 - len));
+            }
+        }
+
+        bool corridors() {
+            if (options.corridor_band > 0) {
+                band_corridors();
+                return true;
+            }
+            if (!tunnel(tunnels, rng, 0, n_i, true)) {
+                return false;
+            }
+            while (cursor < n_i * n_j) {
+                auto i = cursor / n_j;
+                auto j = cursor % n_j;
+                auto r = (i * 2) + 1;
+                auto c = (j * 2) + 1;
+                cursor++;
+
+                if (i < 1 || j < 1) continue;
+                if (cells[r][c].hasType(CORRIDOR))continue;
+                tunnels.push({i, j, ""});
+                if (!tunnel(tunnels, rng, 0, n_i, true)) {
+                    return false;
+                }
+            }
+            cursor = 0;
+            return true;
+        }
 
-                for (decltype(len) c = 0; c < len; c++) {
-                    auto _char = label.substr(c, 1);
-                    cells[label_r][label_c + c].setLabel(_char);
+        //carves every band of corridor_band node rows on its own generator, then joins the bands
+        //each band only writes its own cell rows, so the result depends on the seed and not on the thread count
+        void band_corridors() {
+            auto band = options.corridor_band;
+            auto n_bands = (n_i + band - 1) / band;
+            auto base = static_cast<unsigned>(rng());
+
+            std::atomic<int> next_band{0};
+            auto worker = [&]() {
+                for (int b = next_band++; b < n_bands; b = next_band++) {
+                    carve_band(b, base);
                 }
+            };
+            //run_phase only counts the calling thread
+            std::atomic<size_t> pool_allocations{0};
+            auto n_threads = std::max(1, std::min(options.threads, n_bands)); //n_bands is 0 when n_i is
+            std::vector<std::thread> pool;
+            for (int t = 1; t < n_threads; t++) {
+                pool.emplace_back([&]() {
+                    auto before = allocation_count();
+                    worker();
+                    pool_allocations += allocation_count() - before;
+                });
             }
+            worker();
+            for (auto &thread: pool) {
+                thread.join();
+            }
+            allocations += pool_allocations;
+
+            stitch_bands(base, n_bands);
         }
 
-        void corridors() {
-            for (auto i = 1; i < n_i; i++) {
+        void carve_band(int b, unsigned base) {
+            auto i1 = b * options.corridor_band;
+            auto i2 = std::min(n_i, i1 + options.corridor_band);
+            std::seed_seq seq{base, static_cast<unsigned>(b)};
+            Rng band_rng(seq);
+            TunnelQueue args;
+
+            for (auto i = std::max(1, i1); i < i2; i++) {
                 auto r = (i * 2) + 1;
                 for (auto j = 1; j < n_j; j++) {
                     auto c = (j * 2) + 1;
 
                     if (cells[r][c].hasType(CORRIDOR))continue;
-                    tunnel(i, j);
+                    args.push({i, j, ""});
+                    tunnel(args, band_rng, i1, i2);
+                }
+            }
+        }
+
+        //spanning-tree merge: a wall between two bands is opened only when it joins two unconnected corridor trees
+        void stitch_bands(unsigned base, int n_bands) {
+            std::vector<int> parent(n_i * n_j);
+            std::iota(parent.begin(), parent.end(), 0);
+            auto find = [&](int x) {
+                while (parent[x] != x) {
+                    x = parent[x] = parent[parent[x]];
+                }
+                return x;
+            };
+
+            for (auto i = 0; i < n_i; i++) {
+                auto r = (i * 2) + 1;
+                for (auto j = 0; j < n_j; j++) {
+                    auto c = (j * 2) + 1;
+
+                    if (!cells[r][c].hasType(CORRIDOR)) {
+                        continue;
+                    }
+                    if (j + 1 < n_j && cells[r][c + 1].hasType(CORRIDOR)) {
+                        parent[find(i * n_j + j)] = find(i * n_j + j + 1);
+                    }
+                    if (i + 1 < n_i && cells[r + 1][c].hasType(CORRIDOR)) {
+                        parent[find(i * n_j + j)] = find((i + 1) * n_j + j);
+                    }
+                }
+            }
+
+            std::vector<int> order(n_j);
+            for (auto b = 1; b < n_bands; b++) {
+                auto i = b * options.corridor_band;
+                auto r = (i * 2) + 1;
+                std::seed_seq seq{base, static_cast<unsigned>(n_bands + b)};
+                Rng stitch_rng(seq);
+
+                std::iota(order.begin(), order.end(), 0);
+                std::shuffle(order.begin(), order.end(), stitch_rng);
+                for (auto j: order) {
+                    auto c = (j * 2) + 1;
+
+                    if (!cells[r - 2][c].hasType(CORRIDOR) || !cells[r][c].hasType(CORRIDOR)) {
+                        continue;
+                    }
+                    if (cells[r - 1][c].isBlockedCorridor()) {
+                        continue;
+                    }
+                    auto upper = find((i - 1) * n_j + j);
+                    auto lower = find(i * n_j + j);
+                    if (upper == lower) {
+                        continue;
+                    }
+                    parent[upper] = lower;
+                    delve_tunnel(r - 2, c, r, c);
                 }
             }
         }
 
-        void tunnel(int _i, int _j, const std::string &_last_dir = "") {
-            std::queue<std::tuple<int, int, std::string>> args;
-            args.push(std::make_tuple(_i, _j, _last_dir));
+        //carves from the queued nodes, returns false when it paused with nodes still queued
+        bool tunnel(TunnelQueue &args, Rng &rng, int i_min, int i_max, bool yielding = false) {
             while (!args.empty()) {
-                auto arg = vstd::pop(args);
-                auto dirs = tunnel_dirs(std::get<2>(arg));
+                if (yielding && yield()) {
+                    return false;
+                }
+                auto arg = args.pop();
+                auto dirs = tunnel_dirs(std::get<2>(arg), rng);
                 auto i = std::get<0>(arg);
                 auto j = std::get<1>(arg);
-                for (const auto &dir: dirs)
-                    if (open_tunnel(i, j, dir)) {
-                        auto next_i = i + DI[dir];
-                        auto next_j = j + DJ[dir];
+                for (auto dir: dirs)
+                    if (open_tunnel(i, j, *dir, i_min, i_max)) {
+                        auto next_i = i + DI.at(*dir);
+                        auto next_j = j + DJ.at(*dir);
 
-                        args.push(std::make_tuple(next_i, next_j, dir));
+                        args.push({next_i, next_j, *dir});
                     }
             }
+            return true;
         }
 
-        std::deque<std::string> tunnel_dirs(const std::string &last_dir) {
+        //the four directions in random order, preceded by last_dir when the corridor keeps straight
+        struct TunnelDirs {
+            std::array<const std::string *, 5> dirs;
+            int first = 1;
+
+            auto begin() const {
+                return dirs.begin() + first;
+            }
+
+            auto end() const {
+                return dirs.end();
+            }
+        };
+
+        TunnelDirs tunnel_dirs(const std::string &last_dir, Rng &rng) {
             auto p = options.corridor_layout;
-            std::deque<std::string> dirs;
-            for (auto [key, value]: DJ) {
-                dirs.push_back(key);//TODO: if(vstd::rand(1)push_back():else front
+            TunnelDirs dirs;
+            auto it = dirs.dirs.begin() + 1;
+            for (const auto &[key, value]: DJ) {
+                *it++ = &key;//TODO: if(vstd::rand(1)push_back():else front
             }
-            std::shuffle(dirs.begin(), dirs.end(), vstd::rng());
+            std::shuffle(dirs.dirs.begin() + 1, dirs.dirs.end(), rng);
 
-            if (!last_dir.empty() && p && vstd::rand(100) < p) {
-                dirs.push_front(last_dir);
+            if (!last_dir.empty() && p && random(rng, 100) < p) {
+                dirs.dirs[0] = &DJ.find(last_dir)->first;
+                dirs.first = 0;
             }
             return dirs;
         }
 
-        bool open_tunnel(int i, int j, const std::string &dir) {
+        bool open_tunnel(int i, int j, const std::string &dir, int i_min, int i_max) {
+            auto next_i = i + DI.at(dir);
+            if (next_i < i_min || next_i >= i_max) {
+                return false;
+            }
             auto this_r = (i * 2) + 1;
             auto this_c = (j * 2) + 1;
-            auto next_r = ((i + DI[dir]) * 2) + 1;
-            auto next_c = ((j + DJ[dir]) * 2) + 1;
+            auto next_r = (next_i * 2) + 1;
+            auto next_c = ((j + DJ.at(dir)) * 2) + 1;
             auto mid_r = (this_r + next_r) / 2;
             auto mid_c = (this_c + next_c) / 2;
 
@@ -746,21 +2096,20 @@ public:
             if (n <= 0) {
                 return;
             }
-            auto list = stair_ends();
+            stair_ends();
 
-            if (list.empty()) {
+            if (ends.empty()) {
                 return;
             }
 
             for (int i = 0; i < n; i++) {
-                auto it = list.begin();
-                std::advance(it, vstd::rand(list.size()));
+                auto it = ends.begin() + rand(ends.size());
                 Stairs stairs = *it;
-                list.erase(it);
+                ends.erase(it);
 
                 auto r = stairs.row;
                 auto c = stairs.col;
-                auto type = (i < 2) ? i : vstd::rand(2);
+                auto type = (i < 2) ? i : rand(2);
 
 
                 if (type == 0) {
@@ -776,137 +2125,172 @@ public:
             }
         }
 
-        bool check_tunnel(int r, int c, std::map<std::string, std::vector<std::vector<int>>> check) {
-            for (auto p: check["corridor"]) {
-                if (!cells[r + p[0]][c + p[1]].hasType(CORRIDOR)) {
-                    return false;
+        void index_cells() {
+            open_bits.assign(n_rows + 1, n_cols + 1);
+            corridor_bits.assign(n_rows + 1, n_cols + 1);
+            for (auto r = 0; r <= n_rows; r++) {
+                for (auto c = 0; c <= n_cols; c++) {
+                    open_bits.set(r, c, cells[r][c].isOpenspace());
+                    corridor_bits.set(r, c, cells[r][c].hasType(CORRIDOR));
                 }
             }
-            for (auto p: check["walled"]) {
-                if (cells[r + p[0]][c + p[1]].isOpenspace()) {
+        }
+
+        bool check_corridor(int r, int c, const EndPattern &pattern) {
+            for (auto [dr, dc]: pattern.corridor) {
+                if (!corridor_bits.get(r + dr, c + dc)) {
                     return false;
                 }
             }
             return true;
         }
 
-        std::list<Stairs> stair_ends() {
-            std::list<Stairs> stairs;
+        //fills ends with every dead end a stair can be placed in
+        void stair_ends() {
+            ends.clear();
+            const auto &table = STAIR_TABLE();
+            index_cells();
 
             for (auto i = 0; i < n_i; i++) {
                 auto r = (i * 2) + 1;
+                open_bits.neighbour_codes(r, codes);
                 for (auto j = 0; j < n_j; j++) {
                     auto c = (j * 2) + 1;
 
-                    if (!cells[r][c].hasType(CORRIDOR) || cells[r][c].isStairs()) {
+                    auto match = table.match[codes[c]];
+                    if (!match || !corridor_bits.get(r, c) || cells[r][c].isStairs()) {
                         continue;
                     }
-                    for (auto [dir, dir_value]: STAIR_END) {
-                        if (check_tunnel(r, c, dir_value)) {
+                    for (size_t k = 0; k < table.patterns.size(); k++) {
+                        const auto &pattern = table.patterns[k];
+                        if ((match >> k & 1) && check_corridor(r, c, pattern)) {
                             Stairs end;
                             end.row = r;
                             end.col = c;
+                            end.next_row = end.row + pattern.next.first;
+                            end.next_col = end.col + pattern.next.second;
 
-                            auto n = dir_value["next"];
-                            end.next_row = end.row + n[0][0];
-                            end.next_col = end.col + n[0][1];
-
-                            stairs.push_back(end);
+                            ends.push_back(end);
                             break;
                         }
                     }
                 }
             }
-            return stairs;
         }
 
         void collapse(int r, int c) {
-            if (!(cells[r][c].isOpenspace())) {
+            if (!open_bits.get(r, c)) {
                 return;
             }
-            for (auto [key, value]: CLOSE_END)
-                if (check_tunnel(r, c, value)) {
-                    for (auto p: value["close"]) {
-                        cells[r + p[0]][c + p[1]].clearTypes();
-                    }
-                    for (auto p: value["open"]) {
-                        cells[r + p[0]][c + p[1]].addType(CORRIDOR);
-                    }
-                    for (auto p: value["recurse"]) {
-                        collapse(r + p[0], c + p[1]);
-                    }
+            const auto &table = CLOSE_TABLE();
+            for (size_t k = 0; k < table.patterns.size(); k++) {
+                const auto &pattern = table.patterns[k];
+                if (!(table.match[open_bits.neighbour_code(r, c)] >> k & 1) || !check_corridor(r, c, pattern)) {
+                    continue;
                 }
+                for (auto [dr, dc]: pattern.close) {
+                    cells[r + dr][c + dc].clearTypes();
+                    open_bits.set(r + dr, c + dc, false);
+                    corridor_bits.set(r + dr, c + dc, false);
+                }
+                for (auto [dr, dc]: pattern.open) {
+                    cells[r + dr][c + dc].addType(CORRIDOR);
+                    open_bits.set(r + dr, c + dc, true);
+                    corridor_bits.set(r + dr, c + dc, true);
+                }
+                for (auto [dr, dc]: pattern.recurse) {
+                    collapse(r + dr, c + dc);
+                }
+            }
         }
 
-        void collapse_tunnels(int p) {
+        bool collapse_tunnels(int p) {
             if (!p) {
-                return;
+                return true;
             }
             auto all = p == 100;
+            if (!cursor) {
+                index_cells();
+            }
 
-            for (int i = 0; i < n_i; i++) {
-                auto r = (i * 2) + 1;
-                for (int j = 0; j < n_j; j++) {
-                    auto c = (j * 2) + 1;
+            for (; cursor < n_i * n_j; cursor++) {
+                if (yield()) {
+                    return false;
+                }
+                auto r = (cursor / n_j * 2) + 1;
+                auto c = (cursor % n_j * 2) + 1;
 
-                    if (!(cells[r][c].isOpenspace())) {
-                        continue;
-                    }
-                    if (cells[r][c].isStairs()) {
-                        continue;
-                    }
-                    if (!(all || vstd::rand(100) < p)) {
-                        continue;
-                    }
-                    collapse(r, c);
+                if (!open_bits.get(r, c)) {
+                    continue;
+                }
+                if (cells[r][c].isStairs()) {
+                    continue;
+                }
+                if (!(all || rand(100) < p)) {
+                    continue;
                 }
+                collapse(r, c);
             }
+            cursor = 0;
+            return true;
         }
 
-        void remove_deadends() {
-            collapse_tunnels(options.remove_deadends);
+        bool remove_deadends() {
+            return collapse_tunnels(options.remove_deadends);
         }
 
 
+        //keeps the doors a corridor reached, once per cell, and lays them out in getDoors() as one
+        //contiguous span per room; a door between two rooms is listed in both spans, from each room's side
         void fix_doors() {
-            std::set<std::pair<int, int>> fixed;
-
-            for (auto [room_index, room_data]: rooms) {
-                std::set<std::string> dirs;
-                for (auto [dir, _]: room_data.door) {
-                    dirs.insert(dir);
-                }
-                for (const auto &dir: dirs) {
-                    std::list<Door> shiny;
-                    auto range = room_data.door.equal_range(dir);
-                    for (auto it = range.first; it != range.second; it++) {
-                        auto door = it->second;
-                        auto door_r = door.row;
-                        auto door_c = door.col;
-                        auto door_cell = cells[door_r][door_c];
-                        if (!(door_cell.isOpenspace())) {
-                            continue;
-                        }
+            door_cells.clear();
+            door_cells.reserve(opened.size());
+            door_counts.assign(n_rooms + 1, 0);
+
+            size_t kept = 0;
+            for (size_t k = 0; k < opened.size(); k++) {
+                const auto &door = opened[k].second;
+                if (!cells[door.row][door.col].isOpenspace()) {
+                    continue;
+                }
+                if (!door_cells.insert(uint64_t(door.row) * (n_cols + 1) + door.col)) {
+                    continue;
+                }
+                if (k != kept) {
+                    opened[kept] = std::move(opened[k]);
+                }
+                door_counts[opened[kept].first]++;
+                door_counts[opened[kept].second.out_id]++;
+                kept++;
+            }
+            opened.resize(kept);
 
-                        if (vstd::ctn(fixed, std::make_pair(door_r, door_c))) {
-                            shiny.push_back(door);
-                        } else {
-                            if (auto out_id = door.out_id) {
-                                auto out_dir = OPPOSITE[dir];
-                                rooms[out_id].door.insert(std::make_pair(out_dir, door));
-                            }
-                            shiny.push_back(door);
-                            fixed.insert(std::make_pair(door_r, door_c));
-                        }
-                    }
-                    if (!shiny.empty()) {
-                        room_data.door.erase(dir);
-                        for (const auto &shiny_door: shiny) {
-                            room_data.door.insert(std::make_pair(dir, shiny_door));
-                        }
-                        doors.push_back(shiny);
-                    } else {
-                        room_data.door.erase(dir);
+            int index = 0;
+            for (auto &room: rooms) {
+                room.door_index = index;
+                room.door_count = 0;
+                index += door_counts[room.id];
+            }
+
+            doors.resize(index);
+            auto emplace_door = [&](int room_id, const Door &door) -> Door & {
+                auto &room = rooms[room_id - 1];
+                return doors[room.door_index + room.door_count++] = door;
+            };
+            for (const auto &[room_id, door]: opened) {
+                emplace_door(room_id, door);
+                if (door.out_id) {
+                    auto &back = emplace_door(door.out_id, door);
+                    back.dir = OPPOSITE.at(door.dir);
+                    back.out_id = room_id;
+                }
+            }
+            //insertion sort keeps the spans stable without the buffer std::stable_sort allocates
+            for (const auto &room: rooms) {
+                auto begin = doors.begin() + room.door_index;
+                for (auto it = begin + 1; it < begin + room.door_count; it++) {
+                    for (auto at = it; at != begin && at->dir < (at - 1)->dir; at--) {
+                        std::swap(*at, *(at - 1));
                     }
                 }
             }
@@ -922,34 +2306,260 @@ public:
             }
         }
 
-        void clean_dungeon() {
-            if (options.remove_deadends) {
-                remove_deadends();
+        bool clean_dungeon() {
+            if (options.remove_deadends && !remove_deadends()) {
+                return false;
             }
             fix_doors();
             empty_blocks();
+            return true;
+        }
+    };
+
+    //runs create_dungeon one phase at a time within a time budget, can be cancelled from any thread
+    class Generator {
+    public:
+        explicit Generator(Options options, unsigned seed = std::random_device{}()) :
+                dungeon(std::move(options), seed) {}
+
+        //returns true once the dungeon is complete, false when the budget ran out or it was cancelled
+        template<typename Rep, typename Period>
+        bool step(std::chrono::duration<Rep, Period> budget) {
+            dungeon.budget.cancelled = &cancelled;
+            dungeon.budget.deadline = std::chrono::steady_clock::now() + budget;
+            dungeon.budget.countdown = Dungeon::YIELD_INTERVAL;
+            while (phase != DONE) {
+                if (isCancelled() || !dungeon.run_phase(phase)) {
+                    return false;
+                }
+                phase = static_cast<Phase>(phase + 1);
+                if (std::chrono::steady_clock::now() >= dungeon.budget.deadline) {
+                    break;
+                }
+            }
+            return phase == DONE;
+        }
+
+        //runs the current phase to the end without a budget, returns false once the dungeon is complete
+        bool runPhase() {
+            if (phase == DONE) {
+                return false;
+            }
+            dungeon.budget = {};
+            dungeon.run_phase(phase);
+            phase = static_cast<Phase>(phase + 1);
+            return true;
+        }
+
+        //finishes room placement if it has not been done yet and draws the preview from it, scale nodes per
+        //pixel; step() and runPhase() refine from there, so the finished dungeon has exactly these rooms
+        //while its corridors are only suggested by the skeleton
+        const Preview &preview(int scale = 1) {
+            while (phase <= EMPLACE_ROOMS) {
+                runPhase();
+            }
+            dungeon.sketch(thumbnail, scale);
+            return thumbnail;
+        }
+
+        void cancel() {
+            cancelled = true;
+        }
+
+        bool isCancelled() const {
+            return cancelled;
+        }
+
+        bool isDone() const {
+            return phase == DONE;
+        }
+
+        Phase getPhase() const {
+            return phase;
+        }
+
+        const Dungeon &getDungeon() const {
+            return dungeon;
+        }
+
+        Dungeon take() {
+            dungeon.budget = {};
+            return std::move(dungeon);
+        }
+
+        //starts over on a new dungeon, reusing the buffers of the previous one
+        void reset(Options options, unsigned seed) {
+            dungeon.configure(std::move(options), seed);
+            phase = INIT_CELLS;
+            cancelled = false;
+        }
+
+    private:
+        Dungeon dungeon;
+        Phase phase = INIT_CELLS;
+        std::atomic<bool> cancelled{false};
+        Preview thumbnail;
+    };
+
+#ifdef __cpp_impl_coroutine
+    //coroutine over Generator, each resume runs one time slice; destroying it drops the generation
+    class Task {
+    public:
+        struct promise_type {
+            std::optional<Dungeon> dungeon;
+            Phase phase = INIT_CELLS;
+
+            Task get_return_object() {
+                return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always yield_value(Phase next) {
+                phase = next;
+                return {};
+            }
+
+            void return_value(std::optional<Dungeon> result) {
+                phase = DONE;
+                if (result) {
+                    dungeon.emplace(std::move(*result));
+                }
+            }
+
+            void unhandled_exception() {
+                throw;
+            }
+        };
+
+        Task(Task &&other) noexcept: handle(std::exchange(other.handle, {})) {}
+
+        Task(const Task &) = delete;
+
+        ~Task() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        //returns true while there is work left
+        bool resume() {
+            if (!handle.done()) {
+                handle.resume();
+            }
+            return !handle.done();
+        }
+
+        bool isDone() const {
+            return handle.done();
+        }
+
+        Phase getPhase() const {
+            return handle.promise().phase;
         }
+
+        std::optional<Dungeon> take() {
+            return std::move(handle.promise().dungeon);
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+
+        explicit Task(std::coroutine_handle<promise_type> handle) : handle(handle) {}
     };
 
+    template<typename Rep, typename Period>
+    static Task generate(Options options, unsigned seed, std::chrono::duration<Rep, Period> slice) {
+        Generator generator(std::move(options), seed);
+        while (!generator.step(slice)) {
+            co_yield generator.getPhase();
+        }
+        co_return generator.take();
+    }
+#endif
+
 public:
-    static Dungeon create_dungeon(Options
-                                  options) {
-        Dungeon dungeon(std::move(options));
+    struct Found {
+        Dungeon dungeon;
+        unsigned seed;
+        double fitness;
+    };
 
-        dungeon.init_cells();
+    //generates candidates from seed, seed + 1, ... on worker threads and asks accept after every phase,
+    //dropping a candidate as soon as it returns false; without fitness the passing candidate with the
+    //lowest seed is returned and higher ones are abandoned, with it the fittest passing one, ties going
+    //to the lower seed, so the result does not depend on the thread count
+    static std::optional<Found> search(const Options &options,
+                                       const std::function<bool(const Dungeon &, Phase)> &accept,
+                                       int candidates,
+                                       unsigned seed = std::random_device{}(),
+                                       int threads = 0,
+                                       const std::function<double(const Dungeon &)> &fitness = nullptr) {
+        if (threads <= 0) {
+            threads = std::max(1, int(std::thread::hardware_concurrency()));
+        }
+        std::atomic<int> next{0};
+        std::atomic<int> limit{candidates}; //first passing candidate when there is no fitness
+        std::mutex mutex;
+        std::optional<Found> best;
+        int best_index = candidates;
+
+        auto worker = [&]() {
+            std::optional<Dungeon> dungeon;
+            for (int k = next++; k < limit; k = next++) {
+                auto candidate_seed = seed + unsigned(k);
+                if (dungeon) {
+                    dungeon->configure(options, candidate_seed);
+                } else {
+                    dungeon.emplace(Dungeon(options, candidate_seed));
+                }
 
-        dungeon.emplace_rooms();
+                auto passed = true;
+                for (auto phase = INIT_CELLS; passed && phase != DONE; phase = static_cast<Phase>(phase + 1)) {
+                    dungeon->run_phase(phase);
+                    passed = k < limit && accept(*dungeon, phase);
+                }
+                if (!passed) {
+                    continue;
+                }
 
-        dungeon.open_rooms();
+                auto score = fitness ? fitness(*dungeon) : 0.0;
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!best || score > best->fitness || (score == best->fitness && k < best_index)) {
+                    best.emplace(Found{std::move(*dungeon), candidate_seed, score});
+                    best_index = k;
+                    dungeon.reset();
+                    if (!fitness) {
+                        limit = k;
+                    }
+                }
+            }
+        };
 
-        dungeon.label_rooms();
+        std::vector<std::thread> pool;
+        for (int t = 1; t < std::min(threads, candidates); t++) {
+            pool.emplace_back(worker);
+        }
+        worker();
+        for (auto &thread: pool) {
+            thread.join();
+        }
+        return best;
+    }
 
-        dungeon.corridors();
+    static Dungeon create_dungeon(Options
+                                  options, unsigned seed = std::random_device{}()) {
+        Dungeon dungeon(std::move(options), seed);
 
-        if (dungeon.options.add_stairs) {
-            dungeon.emplace_stairs();
+        for (auto phase = INIT_CELLS; phase != DONE; phase = static_cast<Phase>(phase + 1)) {
+            dungeon.run_phase(phase);
         }
-        dungeon.clean_dungeon();
 
         return dungeon;
     }
@@ -1028,4 +2638,38 @@ std::map<std::string, std::string> rdg<T>::OPPOSITE = {
         {"south", "north"},
         {"west",  "east"},
         {"east",  "west"}
-};
\ No newline at end of file
+};
+
+#ifdef RDG_COUNT_ALLOCATIONS
+#include <cstdlib>
+#include <new>
+
+//replaces the global allocator to feed rdg<>::allocation_count(), define it in one translation unit only
+void *operator new(std::size_t size) {
+    rdg<>::allocation_count()++;
+    if (auto memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) {
+    return ::operator new(size);
+}
+
+void operator delete(void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void *memory, std::size_t) noexcept {
+    std::free(memory);
+}
+#endif
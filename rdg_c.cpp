@@ -0,0 +1,129 @@
+#include <cstddef>
+#include "rdg_c.h"
+#include "rdg_export.h"
+
+using Rdg = rdg<>;
+
+static_assert(sizeof(Rdg::Cell) == sizeof(rdg_cell), "cells are shared without copying");
+static_assert(std::is_standard_layout_v<Rdg::Cell>, "cells are shared without copying");
+static_assert(RDG_STAIR_UP == 1u << Rdg::STAIR_UP, "flag bits follow CellType");
+static_assert(RDG_PORTC == 1u << Rdg::PORTC, "flag bits follow CellType");
+static_assert(Rdg::Grid::ROW_MAJOR, "rdg_cells shares whole rows, build without RDG_TILED_GRID");
+
+struct rdg_dungeon {
+    Rdg::Dungeon dungeon;
+    std::vector<rdg_room> rooms;
+    std::vector<rdg_door> doors;
+    std::vector<rdg_stairs> stairs;
+
+    explicit rdg_dungeon(Rdg::Dungeon _dungeon) : dungeon(std::move(_dungeon)) {
+        for (const auto &room: dungeon.getRooms()) {
+            rooms.push_back({room.id, room.row, room.col, room.north, room.south, room.west, room.east,
+                             room.height, room.width, room.area, room.door_index, room.door_count,
+                             room.label_row, room.label_col});
+        }
+        for (const auto &door: dungeon.getDoors()) {
+            const auto &cell = dungeon.getCells()[door.row][door.col];
+            doors.push_back({door.row, door.col, door.out_id,
+                             cell.getFlags() & (RDG_ARCH | RDG_DOOR | RDG_LOCKED | RDG_TRAPPED | RDG_SECRET | RDG_PORTC),
+                             dir(door.dir)});
+        }
+        for (const auto &s: dungeon.getStairs()) {
+            stairs.push_back({s.row, s.col, s.next_row, s.next_col, s.key == "up" ? RDG_STAIR_UP : RDG_STAIR_DN});
+        }
+    }
+
+    static int32_t dir(const std::string &dir) {
+        if (dir == "north") {
+            return RDG_NORTH;
+        } else if (dir == "south") {
+            return RDG_SOUTH;
+        } else if (dir == "west") {
+            return RDG_WEST;
+        }
+        return RDG_EAST;
+    }
+};
+
+void rdg_default_options(rdg_options *options) {
+    Rdg::Options defaults;
+    options->n_rows = defaults.n_rows;
+    options->n_cols = defaults.n_cols;
+    options->dungeon_layout = "None";
+    options->room_min = defaults.room_min;
+    options->room_max = defaults.room_max;
+    options->room_layout = "Scattered";
+    options->corridor_layout = defaults.corridor_layout;
+    options->remove_deadends = defaults.remove_deadends;
+    options->add_stairs = defaults.add_stairs;
+    options->cell_size = defaults.cell_size;
+    options->corridor_band = defaults.corridor_band;
+    options->threads = defaults.threads;
+}
+
+rdg_dungeon *rdg_create(const rdg_options *options, uint32_t seed) {
+    if (!options) {
+        return nullptr;
+    }
+    try {
+        Rdg::Options o;
+        o.n_rows = options->n_rows;
+        o.n_cols = options->n_cols;
+        o.dungeon_layout = options->dungeon_layout ? options->dungeon_layout : "None";
+        o.room_min = options->room_min;
+        o.room_max = options->room_max;
+        o.room_layout = options->room_layout ? options->room_layout : "Scattered";
+        o.corridor_layout = static_cast<Rdg::CorridorLayout>(options->corridor_layout);
+        o.remove_deadends = options->remove_deadends;
+        o.add_stairs = options->add_stairs;
+        o.cell_size = options->cell_size;
+        o.corridor_band = options->corridor_band;
+        o.threads = options->threads;
+        return new rdg_dungeon(Rdg::create_dungeon(std::move(o), seed));
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void rdg_free(rdg_dungeon *dungeon) {
+    delete dungeon;
+}
+
+const rdg_cell *rdg_cells(const rdg_dungeon *dungeon, int32_t *rows, int32_t *cols, int32_t *row_stride) {
+    const auto &cells = dungeon->dungeon.getCells();
+    if (rows) {
+        *rows = cells.size();
+    }
+    if (cols) {
+        *cols = cells.stride();
+    }
+    if (row_stride) {
+        *row_stride = cells.stride() * sizeof(rdg_cell);
+    }
+    return reinterpret_cast<const rdg_cell *>(cells.data());
+}
+
+const rdg_room *rdg_rooms(const rdg_dungeon *dungeon, int32_t *count) {
+    *count = dungeon->rooms.size();
+    return dungeon->rooms.data();
+}
+
+const rdg_door *rdg_doors(const rdg_dungeon *dungeon, int32_t *count) {
+    *count = dungeon->doors.size();
+    return dungeon->doors.data();
+}
+
+const rdg_stairs *rdg_stairs_list(const rdg_dungeon *dungeon, int32_t *count) {
+    *count = dungeon->stairs.size();
+    return dungeon->stairs.data();
+}
+
+int rdg_write_json(const rdg_dungeon *dungeon, int fd) {
+    rdg_export<>::FdSink sink(fd);
+    return rdg_export<>::json(dungeon->dungeon, sink) ? 0 : -1;
+}
+
+int rdg_write_tmx(const rdg_dungeon *dungeon, int fd, int csv) {
+    rdg_export<>::FdSink sink(fd);
+    return rdg_export<>::tmx(dungeon->dungeon, sink, csv ? rdg_export<>::CSV : rdg_export<>::BASE64_ZLIB) ? 0 : -1;
+}
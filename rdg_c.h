@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* RDG_BUILDING is defined only while building the library itself */
+#if defined(_WIN32) && defined(RDG_BUILDING)
+#define RDG_API __declspec(dllexport)
+#elif defined(_WIN32)
+#define RDG_API __declspec(dllimport)
+#else
+#define RDG_API __attribute__((visibility("default")))
+#endif
+
+/* cell flags: one bit per cell type, door and stair label character in the top byte; room ids are in rdg_room */
+#define RDG_BLOCKED     (1u << 0)
+#define RDG_ROOM        (1u << 1)
+#define RDG_CORRIDOR    (1u << 2)
+#define RDG_PERIMETER   (1u << 3)
+#define RDG_ENTRANCE    (1u << 4)
+#define RDG_ARCH        (1u << 5)
+#define RDG_DOOR        (1u << 6)
+#define RDG_LOCKED      (1u << 7)
+#define RDG_TRAPPED     (1u << 8)
+#define RDG_SECRET      (1u << 9)
+#define RDG_PORTC       (1u << 10)
+#define RDG_STAIR_DN    (1u << 11)
+#define RDG_STAIR_UP    (1u << 12)
+#define RDG_LABEL_SHIFT 24
+
+enum rdg_dir {
+    RDG_NORTH,
+    RDG_SOUTH,
+    RDG_WEST,
+    RDG_EAST
+};
+
+typedef struct rdg_dungeon rdg_dungeon;
+
+typedef struct rdg_options {
+    int32_t n_rows;
+    int32_t n_cols;
+    const char *dungeon_layout;
+    int32_t room_min;
+    int32_t room_max;
+    const char *room_layout;
+    int32_t corridor_layout;
+    int32_t remove_deadends;
+    int32_t add_stairs;
+    int32_t cell_size;
+    int32_t corridor_band;
+    int32_t threads;
+} rdg_options;
+
+typedef struct rdg_cell {
+    uint32_t flags;
+    int32_t room_id;
+} rdg_cell;
+
+typedef struct rdg_room {
+    int32_t id;
+    int32_t row;
+    int32_t col;
+    int32_t north;
+    int32_t south;
+    int32_t west;
+    int32_t east;
+    int32_t height;
+    int32_t width;
+    int32_t area;
+    int32_t door_index;
+    int32_t door_count;
+    int32_t label_row; /* where the id is drawn, first digit */
+    int32_t label_col;
+} rdg_room;
+
+typedef struct rdg_door {
+    int32_t row;
+    int32_t col;
+    int32_t out_id;
+    uint32_t type; /* one of the door flags */
+    int32_t dir;   /* rdg_dir, side of the owning room */
+} rdg_door;
+
+typedef struct rdg_stairs {
+    int32_t row;
+    int32_t col;
+    int32_t next_row;
+    int32_t next_col;
+    uint32_t type; /* RDG_STAIR_DN or RDG_STAIR_UP */
+} rdg_stairs;
+
+/* fills options with the library defaults */
+RDG_API void rdg_default_options(rdg_options *options);
+
+/* returns NULL when generation fails */
+RDG_API rdg_dungeon *rdg_create(const rdg_options *options, uint32_t seed);
+
+RDG_API void rdg_free(rdg_dungeon *dungeon);
+
+/* row-major cell buffer owned by the dungeon, row_stride is in bytes */
+RDG_API const rdg_cell *rdg_cells(const rdg_dungeon *dungeon, int32_t *rows, int32_t *cols, int32_t *row_stride);
+
+/* rooms ordered by id, doors laid out as one span per room */
+RDG_API const rdg_room *rdg_rooms(const rdg_dungeon *dungeon, int32_t *count);
+
+RDG_API const rdg_door *rdg_doors(const rdg_dungeon *dungeon, int32_t *count);
+
+RDG_API const rdg_stairs *rdg_stairs_list(const rdg_dungeon *dungeon, int32_t *count);
+
+/* stream the dungeon to a file descriptor, return 0 on success */
+RDG_API int rdg_write_json(const rdg_dungeon *dungeon, int fd);
+
+RDG_API int rdg_write_tmx(const rdg_dungeon *dungeon, int fd, int csv);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,820 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+#include <vector>
+#include "rdg.h"
+
+//multi-source distance fields (Dijkstra maps) over the walkable cells of a generated dungeon
+template<typename T=void>
+class rdg_distance {
+public:
+    using Dungeon = typename rdg<T>::Dungeon;
+    using Cell = typename rdg<T>::Cell;
+
+    static constexpr uint32_t UNREACHABLE = ~uint32_t(0);
+    static constexpr int MAX_COST = 255;
+
+    //cost of stepping onto a door of the given type, 0 makes it impassable; every other open cell costs 1
+    struct Costs {
+        int locked = 1;
+        int trapped = 1;
+        int secret = 1;
+    };
+
+    rdg_distance(const Dungeon &dungeon, Costs costs = Costs()) : costs(costs) {
+        const auto &cells = dungeon.getCells();
+        n_rows = cells.size();
+        n_cols = cells.stride();
+        weights.assign(size_t(n_rows) * n_cols, 0);
+        for (int r = 0; r < n_rows; r++) {
+            for (int c = 0; c < n_cols; c++) {
+                weights[size_t(r) * n_cols + c] = weight(cells[r][c]);
+            }
+        }
+        for (const auto &room: dungeon.getRooms()) {
+            rects.push_back({room.north, room.west, room.south, room.east});
+        }
+        distances.assign(weights.size(), UNREACHABLE);
+        index();
+    }
+
+    int weight(const Cell &cell) const {
+        if (!cell.isOpenspace()) {
+            return 0;
+        }
+        auto w = 1;
+        if (cell.hasType(rdg<T>::LOCKED)) {
+            w = costs.locked;
+        } else if (cell.hasType(rdg<T>::TRAPPED)) {
+            w = costs.trapped;
+        } else if (cell.hasType(rdg<T>::SECRET)) {
+            w = costs.secret;
+        }
+        return std::clamp(w, 0, MAX_COST);
+    }
+
+    //fills the field from every (row, col) source at distance 0: Dijkstra with a bucket per distance over the
+    //junctions left in the graph and one pass back over the nodes removed from it, then a row at a time every
+    //corridor cell from the two ends of its chain and every room row from the four sides of the room
+    void compute(const std::vector<std::pair<int, int>> &sources) {
+        if (!indexed) {
+            index();
+        }
+        std::fill(node_distances.begin(), node_distances.end(), UNREACHABLE);
+        seeds.clear();
+        this->sources.clear();
+        inner_sources.clear();
+        for (auto [r, c]: sources) {
+            auto cell = size_t(r) * n_cols + c;
+            if (!weights[cell]) {
+                continue;
+            }
+            this->sources.push_back(cell);
+            auto id = slot[cell] & ID_MASK;
+            switch (slot[cell] >> KIND_SHIFT) {
+                case NODE:
+                    reach(id, 0);
+                    break;
+                case CHAIN: {
+                    const auto &chain = chains[chain_of[id]];
+                    auto k = id - chain.first;
+                    reach(chain.from, k + weights[node_cells[chain.from]]);
+                    reach(chain.to, chain.length - 1 - k + weights[node_cells[chain.to]]);
+                    inner_sources.push_back(cell);
+                    break;
+                }
+                default: {
+                    const auto &block = blocks[id];
+                    for (auto p = block.first_portal; p < block.first_portal + block.n_portals; p++) {
+                        reach(portals[p].node, manhattan(cell, node_cells[portals[p].node]));
+                    }
+                    inner_sources.push_back(cell);
+                }
+            }
+        }
+
+        //edges cost at least 1 and less than the number of buckets, seeds join once they are within reach
+        std::sort(seeds.begin(), seeds.end());
+        for (auto &bucket: buckets) {
+            bucket.clear();
+        }
+        size_t pending = 0;
+        size_t next_seed = 0;
+        for (uint32_t d = 0; pending || next_seed < seeds.size(); d++) {
+            if (!pending && seeds[next_seed].first > d) {
+                d = seeds[next_seed].first;
+            }
+            for (; next_seed < seeds.size() && seeds[next_seed].first < d + buckets.size(); next_seed++) {
+                auto [distance, node] = seeds[next_seed];
+                if (distance <= node_distances[node]) {
+                    node_distances[node] = distance;
+                    buckets[distance % buckets.size()].push_back(node);
+                    pending++;
+                }
+            }
+            auto &bucket = buckets[d % buckets.size()];
+            for (auto node: bucket) {
+                if (node_distances[node] != d) {
+                    continue;
+                }
+                for (auto e = first_edge[node]; e < first_edge[node + 1]; e++) {
+                    auto next = edges[e].to;
+                    if (d + edges[e].weight < node_distances[next]) {
+                        node_distances[next] = d + edges[e].weight;
+                        buckets[node_distances[next] % buckets.size()].push_back(next);
+                        pending++;
+                    }
+                }
+            }
+            pending -= bucket.size();
+            bucket.clear();
+        }
+        for (auto k = removed.size(); k-- > 0;) {
+            const auto &bypass = removed[k];
+            auto &distance = node_distances[bypass.node];
+            for (uint32_t e = 0; e < bypass.n_exits; e++) {
+                distance = least(distance, through(node_distances[bypass.exits[e].node], bypass.exits[e].down));
+            }
+        }
+
+        //a row at a time and every room once its last row is done, so every write stays in cache
+        for (int r = 0; r < n_rows; r++) {
+            auto *row = &distances[size_t(r) * n_cols];
+            std::fill(row, row + n_cols, UNREACHABLE);
+            for (auto k = first_path[r]; k < first_path[r + 1]; k++) {
+                const auto &path = paths[k];
+                distances[path.cell] = least(through(node_distances[path.from], path.from_cost),
+                                             through(node_distances[path.to], path.to_cost));
+            }
+            for (auto k = first_ending[r]; k < first_ending[r + 1]; k++) {
+                fill_block(blocks[ending[k]]);
+            }
+        }
+
+        //sources inside a corridor or a room reach the cells around them directly as well as through its ends
+        for (auto cell: inner_sources) {
+            auto id = slot[cell] & ID_MASK;
+            if (slot[cell] >> KIND_SHIFT == CHAIN) {
+                const auto &chain = chains[chain_of[id]];
+                for (auto k = chain.first; k < chain.first + chain.length; k++) {
+                    auto &distance = distances[chain_cells[k]];
+                    distance = std::min(distance, uint32_t(std::abs(int(k) - int(id))));
+                }
+            } else {
+                const auto &block = blocks[id];
+                for (int r = block.north; r <= block.south; r++) {
+                    relax_row(&distances[size_t(r) * n_cols], block.west, block.east,
+                              std::abs(r - row_of(cell)), col_of(cell));
+                }
+            }
+        }
+    }
+
+    uint32_t get(int r, int c) const {
+        return distances[size_t(r) * n_cols + c];
+    }
+
+    //row-major, UNREACHABLE for cells no source reaches
+    const std::vector<uint32_t> &getDistances() const {
+        return distances;
+    }
+
+    //applies a changed cell to the computed field, returning whether its cost changed;
+    //a cheaper cell improves outwards from itself, a dearer one clears the cells whose shortest path ran
+    //through it and refills them from the intact cells around them; the next compute() indexes the map again
+    bool update(int r, int c, const Cell &cell) {
+        auto at = size_t(r) * n_cols + c;
+        auto old_weight = weights[at];
+        auto new_weight = weight(cell);
+        if (new_weight == old_weight) {
+            return false;
+        }
+        weights[at] = new_weight;
+        indexed = false;
+
+        queue = {};
+        if (new_weight && (!old_weight || new_weight < old_weight)) {
+            auto best = is_source(at) ? 0 : around(at, new_weight);
+            if (best < distances[at]) {
+                distances[at] = best;
+                queue.push({best, at});
+            }
+        } else {
+            invalidated.clear();
+            invalidated.push_back(at);
+            auto old_distance = distances[at];
+            distances[at] = UNREACHABLE;
+            stack.clear();
+            stack.emplace_back(at, old_distance);
+            while (!stack.empty()) {
+                auto [cell, distance] = stack.back();
+                stack.pop_back();
+                if (distance == UNREACHABLE) {
+                    continue;
+                }
+                neighbours(cell, [&](size_t next) {
+                    if (distances[next] != UNREACHABLE && distances[next] != 0
+                        && distances[next] == distance + weights[next]) {
+                        stack.emplace_back(next, distances[next]);
+                        invalidated.push_back(next);
+                        distances[next] = UNREACHABLE;
+                    }
+                });
+            }
+            for (auto cell: invalidated) {
+                if (!weights[cell]) {
+                    continue;
+                }
+                auto best = is_source(cell) ? 0 : around(cell, weights[cell]);
+                if (best != UNREACHABLE) {
+                    distances[cell] = best;
+                    queue.push({best, cell});
+                }
+            }
+        }
+
+        while (!queue.empty()) {
+            auto [distance, cell] = queue.top();
+            queue.pop();
+            if (distance != distances[cell]) {
+                continue;
+            }
+            neighbours(cell, [&](size_t next) {
+                auto relaxed = distance + weights[next];
+                if (weights[next] && relaxed < distances[next]) {
+                    distances[next] = relaxed;
+                    queue.push({relaxed, next});
+                }
+            });
+        }
+        return true;
+    }
+
+private:
+    //rooms with more openings than this are indexed cell by cell
+    static constexpr uint32_t MAX_PORTALS = 32;
+    //offsets a Path holds to either of its ends
+    using PathCost = uint16_t;
+    static constexpr uint32_t MAX_PATH_COST = std::numeric_limits<PathCost>::max();
+    //longer corridors are split by a node, a cell is at most the chain's length from either end
+    static constexpr uint32_t MAX_CHAIN = MAX_PATH_COST - 1;
+    static_assert(MAX_CHAIN <= MAX_PATH_COST, "chain offsets must fit a Path");
+    static constexpr uint32_t NONE = ~uint32_t(0);
+    //unreached in sides, far enough below UNREACHABLE to add a room's size to
+    static constexpr uint32_t FAR = UNREACHABLE / 2;
+
+    //what a cell was indexed as, in the top bits of its slot
+    enum Kind : uint32_t {
+        WALL,
+        NODE, //id is the node
+        CHAIN, //cost 1 with exactly two open neighbours, id is its place in chain_cells
+        BLOCK //inside an open room rectangle without open neighbours outside it, id is the block
+    };
+    static constexpr uint32_t KIND_SHIFT = 30;
+    static constexpr uint32_t ID_MASK = (1u << KIND_SHIFT) - 1;
+
+    struct Rect {
+        int north;
+        int west;
+        int south;
+        int east;
+    };
+
+    //corridor cells chain_cells[first, first + length) running from next to node from to next to node to
+    struct Chain {
+        uint32_t from;
+        uint32_t to;
+        uint32_t first;
+        uint32_t length;
+    };
+
+    struct Portal {
+        uint32_t node;
+        int row;
+        int col;
+    };
+
+    //a room whose cells all cost 1, entered only through its portal nodes
+    struct Block : Rect {
+        uint32_t first_portal;
+        uint32_t n_portals;
+        uint32_t first_side = 0; //into portal_sides
+        uint32_t n_sides = 0;
+    };
+
+    //a portal on one side of its block, relaxing sides[first, first + length) from at
+    struct PortalSide {
+        uint32_t node;
+        uint32_t first;
+        uint32_t length;
+        uint32_t at;
+    };
+
+    struct Edge {
+        uint32_t to;
+        uint32_t weight;
+    };
+
+    //a neighbour of a removed node, with the cost to and from it
+    struct Exit {
+        uint32_t node;
+        uint32_t up; //cost from the removed node to it
+        uint32_t down; //cost from it to the removed node
+    };
+
+    //node cut off with the one link it had left, or bypassed by a link between the two
+    struct Removed {
+        uint32_t node;
+        uint32_t n_exits;
+        Exit exits[2];
+    };
+
+    //a node, corridor cell or cell of a room filled like one, min(from + from_cost, to + to_cost) away
+    struct Path {
+        uint32_t cell;
+        uint32_t from;
+        uint32_t to;
+        PathCost from_cost;
+        PathCost to_cost;
+    };
+
+    Costs costs;
+    int n_rows = 0;
+    int n_cols = 0;
+    std::vector<uint8_t> weights; //per cell, 0 when it cannot be entered
+    std::vector<Rect> rects;
+    std::vector<uint32_t> distances;
+    std::vector<size_t> sources;
+
+    bool indexed = false;
+    std::vector<uint32_t> slot; //per cell, kind and id
+    std::vector<size_t> node_cells;
+    std::vector<Chain> chains;
+    std::vector<uint32_t> chain_cells;
+    std::vector<uint32_t> chain_of; //per chain cell
+    std::vector<Block> blocks;
+    std::vector<Portal> portals;
+    std::vector<PortalSide> portal_sides; //corner portals are on two sides
+    std::vector<uint32_t> first_edge; //per node, into edges; only junctions left in the graph have any
+    std::vector<Edge> edges;
+    std::vector<Removed> removed; //in the order they were removed
+    std::vector<uint32_t> removed_at; //per node, into removed, NONE for junctions left in the graph
+    std::vector<Path> paths; //in cell order
+    std::vector<uint32_t> first_path; //per row, into paths
+    std::vector<uint32_t> ending; //blocks by their last row
+    std::vector<uint32_t> first_ending; //per row, into ending
+
+    std::vector<uint32_t> node_distances;
+    std::vector<std::pair<uint32_t, uint32_t>> seeds; //distance and junction left in the graph
+    std::vector<std::vector<uint32_t>> buckets; //nodes by distance % (heaviest edge + 1)
+    std::vector<std::pair<uint32_t, uint32_t>> reaching; //node and distance
+    //the north and south rows and west and east columns of the block being filled, from the portals on them
+    std::vector<uint32_t> sides;
+    std::vector<size_t> inner_sources;
+
+    //partial update scratch
+    std::vector<size_t> invalidated;
+    std::vector<std::pair<size_t, uint32_t>> stack;
+    std::priority_queue<std::pair<uint32_t, size_t>, std::vector<std::pair<uint32_t, size_t>>,
+            std::greater<>> queue;
+
+    //sets a node's distance; a removed node passes it on to the nodes it was removed towards
+    void reach(uint32_t node, uint32_t distance) {
+        reaching.clear();
+        reaching.emplace_back(node, distance);
+        while (!reaching.empty()) {
+            auto [at, d] = reaching.back();
+            reaching.pop_back();
+            auto k = removed_at[at];
+            if (k == NONE) {
+                seeds.push_back({d, at});
+            } else if (d < node_distances[at]) {
+                node_distances[at] = d;
+                for (uint32_t e = 0; e < removed[k].n_exits; e++) {
+                    reaching.emplace_back(removed[k].exits[e].node, d + removed[k].exits[e].up);
+                }
+            }
+        }
+    }
+
+    //every cell of a block is reached straight from one of its four sides, so a row is the least of four
+    //profiles, relaxed from the portals on each side; no branches along the row, so the compiler vectorizes it
+    void fill_block(const Block &block) {
+        auto width = block.east - block.west + 1;
+        auto height = block.south - block.north + 1;
+        auto *north = sides.data();
+        auto *south = north + width;
+        auto *west = south + width;
+        auto *east = west + height;
+        std::fill(north, east + height, FAR);
+        auto nearest = FAR;
+        for (auto s = block.first_side; s < block.first_side + block.n_sides; s++) {
+            const auto &side = portal_sides[s];
+            auto distance = least(node_distances[side.node], FAR);
+            nearest = least(nearest, distance);
+            relax_row(north + side.first, 0, int(side.length) - 1, distance, int(side.at));
+        }
+        if (nearest == FAR) {
+            return;
+        }
+        for (int r = 0; r < height; r++) {
+            auto *row = &distances[size_t(block.north + r) * n_cols + block.west];
+            auto from_north = uint32_t(r);
+            auto from_south = uint32_t(height - 1 - r);
+            for (int c = 0; c < width; c++) {
+                auto distance = least(least(north[c] + from_north, south[c] + from_south),
+                                      least(west[r] + c, east[r] + (width - 1 - c)));
+                row[c] = distance < FAR ? distance : UNREACHABLE;
+            }
+        }
+    }
+
+    //a room with one or two openings is filled like a corridor, from each opening plus the walk from it;
+    //without any it is never reached; its portals lie on its border, so no offset exceeds its height plus width
+    static bool by_paths(const Block &block) {
+        return block.n_portals <= 2
+               && uint32_t(block.south - block.north + block.east - block.west) <= MAX_PATH_COST;
+    }
+
+    //by value, unlike std::min, so it compiles to a conditional move or a vector min instead of a branch
+    static uint32_t least(uint32_t a, uint32_t b) {
+        return a < b ? a : b;
+    }
+
+    static uint32_t through(uint32_t distance, uint32_t cost) {
+        return distance == UNREACHABLE ? UNREACHABLE : distance + cost;
+    }
+
+    //row[c] = min(row[c], base + |c - col|) over columns c1 to c2, branch free so the compiler can vectorize it
+    static void relax_row(uint32_t *row, int c1, int c2, uint32_t base, int col) {
+        for (int c = c1; c <= c2; c++) {
+            row[c] = least(row[c], base + uint32_t(std::abs(c - col)));
+        }
+    }
+
+    //corridor cells with two open neighbours collapse into chains between junction nodes, rooms that are still
+    //open rectangles into their openings, and only junctions of three or more links stay in the graph
+    void index() {
+        slot.assign(weights.size(), WALL << KIND_SHIFT);
+        node_cells.clear();
+        chains.clear();
+        chain_cells.clear();
+        chain_of.clear();
+        blocks.clear();
+        portals.clear();
+
+        std::vector<size_t> openings;
+        for (const auto &rect: rects) {
+            auto open = true;
+            for (int r = rect.north; r <= rect.south && open; r++) {
+                for (int c = rect.west; c <= rect.east && open; c++) {
+                    auto cell = size_t(r) * n_cols + c;
+                    open = weights[cell] == 1 && slot[cell] >> KIND_SHIFT == WALL;
+                }
+            }
+            if (!open) {
+                continue;
+            }
+            openings.clear();
+            for (int r = rect.north; r <= rect.south; r++) {
+                auto step = r == rect.north || r == rect.south ? 1 : std::max(1, rect.east - rect.west);
+                for (int c = rect.west; c <= rect.east; c += step) {
+                    auto cell = size_t(r) * n_cols + c;
+                    auto outside = false;
+                    neighbours(cell, [&](size_t next) {
+                        auto vertical = next + n_cols == cell || next == cell + n_cols;
+                        auto nr = vertical ? (next < cell ? r - 1 : r + 1) : r;
+                        auto nc = vertical ? c : (next < cell ? c - 1 : c + 1);
+                        outside |= weights[next] && (nr < rect.north || nr > rect.south
+                                                     || nc < rect.west || nc > rect.east);
+                    });
+                    if (outside) {
+                        openings.push_back(cell);
+                    }
+                }
+            }
+            if (openings.size() > MAX_PORTALS) {
+                continue;
+            }
+            auto block = uint32_t(blocks.size());
+            for (int r = rect.north; r <= rect.south; r++) {
+                for (int c = rect.west; c <= rect.east; c++) {
+                    slot[size_t(r) * n_cols + c] = BLOCK << KIND_SHIFT | block;
+                }
+            }
+            for (auto cell: openings) {
+                slot[cell] = NODE << KIND_SHIFT | block;
+                portals.push_back({uint32_t(cell), row_of(cell), col_of(cell)});
+            }
+            blocks.push_back({rect, uint32_t(portals.size() - openings.size()), uint32_t(openings.size())});
+        }
+
+        //nodes in cell order: portals, dearer cells and every cell that is not the middle of a corridor
+        std::vector<int32_t> node_blocks; //block a portal opens, -1 for other nodes
+        for (size_t cell = 0; cell < weights.size(); cell++) {
+            if (!weights[cell] || slot[cell] >> KIND_SHIFT == BLOCK) {
+                continue;
+            }
+            auto open = 0;
+            neighbours(cell, [&](size_t next) {
+                open += weights[next] != 0;
+            });
+            auto portal = slot[cell] >> KIND_SHIFT == NODE;
+            if (portal || weights[cell] > 1 || open != 2) {
+                node_blocks.push_back(portal ? int32_t(slot[cell] & ID_MASK) : -1);
+                slot[cell] = NODE << KIND_SHIFT | uint32_t(node_cells.size());
+                node_cells.push_back(cell);
+            } else {
+                slot[cell] = CHAIN << KIND_SHIFT | ID_MASK;
+            }
+        }
+        for (auto &portal: portals) {
+            portal.node = slot[portal.node] & ID_MASK;
+        }
+        portal_sides.clear();
+        for (auto &block: blocks) {
+            auto width = uint32_t(block.east - block.west + 1);
+            auto height = uint32_t(block.south - block.north + 1);
+            block.first_side = uint32_t(portal_sides.size());
+            for (auto p = block.first_portal; p < block.first_portal + block.n_portals; p++) {
+                const auto &portal = portals[p];
+                auto row = uint32_t(portal.row - block.north);
+                auto col = uint32_t(portal.col - block.west);
+                if (row == 0) {
+                    portal_sides.push_back({portal.node, 0, width, col});
+                }
+                if (row == height - 1) {
+                    portal_sides.push_back({portal.node, width, width, col});
+                }
+                if (col == 0) {
+                    portal_sides.push_back({portal.node, 2 * width, height, row});
+                }
+                if (col == width - 1) {
+                    portal_sides.push_back({portal.node, 2 * width + height, height, row});
+                }
+            }
+            block.n_sides = uint32_t(portal_sides.size()) - block.first_side;
+        }
+
+        //undirected links between nodes, with the cost of each direction
+        struct Link {
+            uint32_t a;
+            uint32_t b;
+            uint32_t ab;
+            uint32_t ba;
+        };
+        std::vector<Link> links;
+        auto follow = [&](uint32_t from, size_t previous, size_t cell) {
+            auto chain = uint32_t(chains.size());
+            auto first = uint32_t(chain_cells.size());
+            while (slot[cell] >> KIND_SHIFT == CHAIN && chain_cells.size() - first < MAX_CHAIN) {
+                slot[cell] = CHAIN << KIND_SHIFT | uint32_t(chain_cells.size());
+                chain_cells.push_back(uint32_t(cell));
+                chain_of.push_back(chain);
+                auto next = cell;
+                neighbours(cell, [&](size_t around) {
+                    if (around != previous && weights[around]) {
+                        next = around;
+                    }
+                });
+                previous = cell;
+                cell = next;
+            }
+            if (slot[cell] >> KIND_SHIFT == CHAIN) {
+                slot[cell] = NODE << KIND_SHIFT | uint32_t(node_cells.size());
+                node_cells.push_back(cell);
+                node_blocks.push_back(-1);
+            }
+            auto to = slot[cell] & ID_MASK;
+            auto length = uint32_t(chain_cells.size()) - first;
+            chains.push_back({from, to, first, length});
+            links.push_back({from, to, length + weights[cell], length + weights[node_cells[from]]});
+        };
+        auto unfollowed = [&](size_t cell) {
+            return slot[cell] == (CHAIN << KIND_SHIFT | ID_MASK);
+        };
+        for (uint32_t node = 0; node < node_cells.size(); node++) {
+            auto cell = node_cells[node];
+            neighbours(cell, [&](size_t next) {
+                if (unfollowed(next)) {
+                    follow(node, cell, next);
+                } else if (slot[next] >> KIND_SHIFT == NODE) {
+                    auto other = slot[next] & ID_MASK;
+                    if (other > node && (node_blocks[node] < 0 || node_blocks[node] != node_blocks[other])) {
+                        links.push_back({node, other, weights[next], weights[cell]});
+                    }
+                }
+            });
+        }
+        //corridor loops without a junction get one
+        for (size_t cell = 0; cell < weights.size(); cell++) {
+            if (unfollowed(cell)) {
+                auto node = uint32_t(node_cells.size());
+                slot[cell] = NODE << KIND_SHIFT | node;
+                node_cells.push_back(cell);
+                node_blocks.push_back(-1);
+                neighbours(cell, [&](size_t next) {
+                    if (unfollowed(next)) {
+                        follow(node, cell, next);
+                    }
+                });
+            }
+        }
+        for (const auto &block: blocks) {
+            for (auto p = block.first_portal; p < block.first_portal + block.n_portals; p++) {
+                for (auto q = p + 1; q < block.first_portal + block.n_portals; q++) {
+                    auto w = uint32_t(std::abs(portals[p].row - portals[q].row)
+                                      + std::abs(portals[p].col - portals[q].col));
+                    links.push_back({portals[p].node, portals[q].node, w, w});
+                }
+            }
+        }
+
+        //cut off nodes with one link and bypass nodes with two until only junctions of three or more are left;
+        //corridor loops back to the same node never shorten a path between nodes
+        auto n_nodes = node_cells.size();
+        std::vector<uint32_t> degree(n_nodes, 0);
+        std::vector<uint32_t> head(n_nodes, NONE); //per node, its last half in halves
+        std::vector<std::pair<uint32_t, uint32_t>> halves; //link and the node's previous half
+        std::vector<uint8_t> cut(links.size(), 0);
+        auto attach = [&](uint32_t l) {
+            for (auto node: {links[l].a, links[l].b}) {
+                halves.push_back({l, head[node]});
+                head[node] = uint32_t(halves.size() - 1);
+                degree[node]++;
+            }
+        };
+        for (uint32_t l = 0; l < links.size(); l++) {
+            if (links[l].a == links[l].b) {
+                cut[l] = 1;
+            } else {
+                attach(l);
+            }
+        }
+        removed.clear();
+        removed_at.assign(n_nodes, NONE);
+        std::vector<uint32_t> work;
+        for (uint32_t node = 0; node < n_nodes; node++) {
+            if (degree[node] == 1 || degree[node] == 2) {
+                work.push_back(node);
+            }
+        }
+        while (!work.empty()) {
+            auto node = work.back();
+            work.pop_back();
+            if (removed_at[node] != NONE || degree[node] == 0 || degree[node] > 2) {
+                continue;
+            }
+            Removed bypass{node, 0, {}};
+            for (auto h = head[node]; h != NONE; h = halves[h].second) {
+                auto l = halves[h].first;
+                if (cut[l]) {
+                    continue;
+                }
+                auto link = links[l];
+                auto forward = link.a == node;
+                bypass.exits[bypass.n_exits++] = {forward ? link.b : link.a, forward ? link.ab : link.ba,
+                                                  forward ? link.ba : link.ab};
+                cut[l] = 1;
+            }
+            degree[node] = 0;
+            const auto &exits = bypass.exits;
+            if (bypass.n_exits == 2 && exits[0].node != exits[1].node) {
+                links.push_back({exits[0].node, exits[1].node, exits[0].down + exits[1].up,
+                                 exits[1].down + exits[0].up});
+                cut.push_back(0);
+                degree[exits[0].node]--;
+                degree[exits[1].node]--;
+                attach(uint32_t(links.size() - 1));
+            } else {
+                for (uint32_t e = 0; e < bypass.n_exits; e++) {
+                    if (--degree[exits[e].node] <= 2) {
+                        work.push_back(exits[e].node);
+                    }
+                }
+            }
+            removed_at[node] = uint32_t(removed.size());
+            removed.push_back(bypass);
+        }
+
+        uint32_t heaviest = 1;
+        first_edge.assign(n_nodes + 1, 0);
+        for (uint32_t l = 0; l < links.size(); l++) {
+            if (!cut[l]) {
+                first_edge[links[l].a + 1]++;
+                first_edge[links[l].b + 1]++;
+                heaviest = std::max({heaviest, links[l].ab, links[l].ba});
+            }
+        }
+        for (size_t node = 0; node < n_nodes; node++) {
+            first_edge[node + 1] += first_edge[node];
+        }
+        edges.resize(first_edge.back());
+        auto fill = first_edge;
+        for (uint32_t l = 0; l < links.size(); l++) {
+            if (!cut[l]) {
+                edges[fill[links[l].a]++] = {links[l].b, links[l].ab};
+                edges[fill[links[l].b]++] = {links[l].a, links[l].ba};
+            }
+        }
+        node_distances.assign(n_nodes, UNREACHABLE);
+        buckets.resize(heaviest + 1);
+
+        paths.clear();
+        first_path.assign(n_rows + 1, 0);
+        for (int r = 0; r < n_rows; r++) {
+            first_path[r] = uint32_t(paths.size());
+            for (auto cell = size_t(r) * n_cols; cell < size_t(r + 1) * n_cols; cell++) {
+                auto id = slot[cell] & ID_MASK;
+                if (slot[cell] >> KIND_SHIFT == NODE) {
+                    paths.push_back({uint32_t(cell), id, id, 0, 0});
+                } else if (slot[cell] >> KIND_SHIFT == CHAIN) {
+                    const auto &chain = chains[chain_of[id]];
+                    auto k = id - chain.first;
+                    paths.push_back({uint32_t(cell), chain.from, chain.to, PathCost(k + 1),
+                                     PathCost(chain.length - k)});
+                } else if (slot[cell] >> KIND_SHIFT == BLOCK && by_paths(blocks[id]) && blocks[id].n_portals) {
+                    const auto &from = portals[blocks[id].first_portal];
+                    const auto &to = portals[blocks[id].first_portal + blocks[id].n_portals - 1];
+                    auto c = int(cell - size_t(r) * n_cols);
+                    paths.push_back({uint32_t(cell), from.node, to.node,
+                                     PathCost(std::abs(r - from.row) + std::abs(c - from.col)),
+                                     PathCost(std::abs(r - to.row) + std::abs(c - to.col))});
+                }
+            }
+        }
+        first_path[n_rows] = uint32_t(paths.size());
+        first_ending.assign(n_rows + 1, 0);
+        size_t largest = 0;
+        for (const auto &block: blocks) {
+            if (by_paths(block)) {
+                continue;
+            }
+            first_ending[block.south + 1]++;
+            largest = std::max(largest, size_t(2 * (block.east - block.west + block.south - block.north + 2)));
+        }
+        for (int r = 0; r < n_rows; r++) {
+            first_ending[r + 1] += first_ending[r];
+        }
+        ending.resize(first_ending[n_rows]);
+        auto next_ending = first_ending;
+        for (uint32_t block = 0; block < blocks.size(); block++) {
+            if (!by_paths(blocks[block])) {
+                ending[next_ending[blocks[block].south]++] = block;
+            }
+        }
+        sides.resize(largest);
+        indexed = true;
+    }
+
+    //32 bit, a 64 bit division costs several times as much and the index divides for every cell
+    int row_of(size_t cell) const {
+        return int(uint32_t(cell) / uint32_t(n_cols));
+    }
+
+    int col_of(size_t cell) const {
+        return int(uint32_t(cell) % uint32_t(n_cols));
+    }
+
+    uint32_t manhattan(size_t a, size_t b) const {
+        return std::abs(row_of(a) - row_of(b)) + std::abs(col_of(a) - col_of(b));
+    }
+
+    bool is_source(size_t cell) const {
+        return std::find(sources.begin(), sources.end(), cell) != sources.end();
+    }
+
+    template<typename F>
+    void neighbours(size_t cell, F f) const {
+        auto c = col_of(cell);
+        if (cell >= size_t(n_cols)) {
+            f(cell - n_cols);
+        }
+        if (cell + n_cols < weights.size()) {
+            f(cell + n_cols);
+        }
+        if (c > 0) {
+            f(cell - 1);
+        }
+        if (c + 1 < n_cols) {
+            f(cell + 1);
+        }
+    }
+
+    //best distance to a cell of the given weight through its neighbours
+    uint32_t around(size_t cell, int weight) const {
+        auto best = UNREACHABLE;
+        neighbours(cell, [&](size_t next) {
+            if (distances[next] != UNREACHABLE) {
+                best = std::min(best, distances[next] + weight);
+            }
+        });
+        return best;
+    }
+};
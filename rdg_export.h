@@ -0,0 +1,490 @@
+#pragma once
+
+#include <unistd.h>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <string_view>
+#include <zlib.h>
+#include "rdg.h"
+
+template<typename T=void>
+class rdg_export {
+public:
+    using Dungeon = typename rdg<T>::Dungeon;
+    using Cell = typename rdg<T>::Cell;
+
+    //buffered byte sink, memory use is the fixed buffer regardless of the map size
+    class Sink {
+    public:
+        virtual ~Sink() = default;
+
+        void put(const char *data, size_t size) {
+            while (size > 0) {
+                if (used == sizeof(buffer)) {
+                    drain();
+                }
+                auto n = std::min(size, sizeof(buffer) - used);
+                memcpy(buffer + used, data, n);
+                used += n;
+                data += n;
+                size -= n;
+            }
+        }
+
+        void put(std::string_view text) {
+            put(text.data(), text.size());
+        }
+
+        void put(char c) {
+            if (used == sizeof(buffer)) {
+                drain();
+            }
+            buffer[used++] = c;
+        }
+
+        void put(long long value) {
+            if (sizeof(buffer) - used < 24) {
+                drain();
+            }
+            used = std::to_chars(buffer + used, buffer + sizeof(buffer), value).ptr - buffer;
+        }
+
+        //true when everything put so far was written in full
+        bool flush() {
+            drain();
+            return !failed && complete();
+        }
+
+        //false once a write failed, nothing put after that is written
+        bool good() const {
+            return !failed;
+        }
+
+    protected:
+        virtual bool write(const char *data, size_t size) = 0;
+
+        //false when the sink accepted data it could not keep
+        virtual bool complete() const {
+            return true;
+        }
+
+    private:
+        char buffer[1 << 16];
+        size_t used = 0;
+        bool failed = false;
+
+        void drain() {
+            if (used && !failed) {
+                failed = !write(buffer, used);
+            }
+            used = 0;
+        }
+    };
+
+    class FdSink : public Sink {
+    public:
+        explicit FdSink(int fd) : fd(fd) {}
+
+        ~FdSink() override {
+            this->flush();
+        }
+
+    protected:
+        bool write(const char *data, size_t size) override {
+            while (size > 0) {
+                auto n = ::write(fd, data, size);
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                data += n;
+                size -= n;
+            }
+            return true;
+        }
+
+    private:
+        int fd;
+    };
+
+    //writes into caller memory; on overflow keeps taking data and counting it, so the export runs to the end,
+    //returns false and size() tells how much was needed
+    class BufferSink : public Sink {
+    public:
+        BufferSink(char *out, size_t capacity) : out(out), capacity(capacity) {}
+
+        size_t size() const {
+            return written;
+        }
+
+    protected:
+        bool write(const char *data, size_t size) override {
+            if (written < capacity) {
+                memcpy(out + written, data, std::min(size, capacity - written));
+            }
+            written += size;
+            return true;
+        }
+
+        bool complete() const override {
+            return written <= capacity;
+        }
+
+    private:
+        char *out;
+        size_t capacity;
+        size_t written = 0;
+    };
+
+    enum Encoding {
+        CSV,
+        BASE64_ZLIB
+    };
+
+    //tile ids of the TMX tileset, gid is the tile id plus one
+    enum Tile {
+        NOTHING_TILE = -1,
+        ROOM_TILE,
+        CORRIDOR_TILE,
+        ARCH_TILE,
+        DOOR_TILE,
+        LOCKED_TILE,
+        TRAPPED_TILE,
+        SECRET_TILE,
+        PORTC_TILE,
+        STAIR_DN_TILE,
+        STAIR_UP_TILE,
+        TILE_COUNT
+    };
+
+    static bool json(const Dungeon &dungeon, Sink &sink) {
+        const auto &cells = dungeon.getCells();
+        sink.put(std::string_view("{\"n_rows\":"));
+        sink.put((long long) cells.size());
+        sink.put(std::string_view(",\"n_cols\":"));
+        sink.put((long long) (cells.empty() ? 0 : cells[0].size()));
+
+        sink.put(std::string_view(",\"cells\":["));
+        for (size_t r = 0; r < cells.size(); r++) {
+            sink.put(r ? std::string_view(",[") : std::string_view("["));
+            for (size_t c = 0; c < cells[r].size(); c++) {
+                if (c) {
+                    sink.put(',');
+                }
+                sink.put((long long) cells[r][c].getFlags());
+            }
+            sink.put(']');
+        }
+
+        sink.put(std::string_view("],\"rooms\":["));
+        bool first = true;
+        for (const auto &room: dungeon.getRooms()) {
+            sink.put(first ? std::string_view("{") : std::string_view(",{"));
+            first = false;
+            field(sink, "id", room.id, true);
+            field(sink, "row", room.row);
+            field(sink, "col", room.col);
+            field(sink, "north", room.north);
+            field(sink, "south", room.south);
+            field(sink, "west", room.west);
+            field(sink, "east", room.east);
+            field(sink, "height", room.height);
+            field(sink, "width", room.width);
+            field(sink, "area", room.area);
+            field(sink, "door_index", room.door_index);
+            field(sink, "door_count", room.door_count);
+            field(sink, "label_row", room.label_row);
+            field(sink, "label_col", room.label_col);
+            sink.put('}');
+        }
+
+        sink.put(std::string_view("],\"doors\":["));
+        first = true;
+        for (const auto &door: dungeon.getDoors()) {
+            sink.put(first ? std::string_view("{") : std::string_view(",{"));
+            first = false;
+            field(sink, "row", door.row, true);
+            field(sink, "col", door.col);
+            field(sink, "key", door.key);
+            field(sink, "type", door.type);
+            field(sink, "dir", door.dir);
+            field(sink, "out_id", door.out_id);
+            sink.put('}');
+        }
+
+        sink.put(std::string_view("],\"stairs\":["));
+        first = true;
+        for (const auto &stairs: dungeon.getStairs()) {
+            sink.put(first ? std::string_view("{") : std::string_view(",{"));
+            first = false;
+            field(sink, "row", stairs.row, true);
+            field(sink, "col", stairs.col);
+            field(sink, "next_row", stairs.next_row);
+            field(sink, "next_col", stairs.next_col);
+            field(sink, "key", stairs.key);
+            sink.put('}');
+        }
+        sink.put(std::string_view("]}\n"));
+        return sink.flush();
+    }
+
+    static bool tmx(const Dungeon &dungeon, Sink &sink, Encoding encoding = BASE64_ZLIB) {
+        const auto &cells = dungeon.getCells();
+        long long height = cells.size();
+        long long width = cells.empty() ? 0 : cells[0].size();
+        long long size = dungeon.getOptions().cell_size;
+        long long objects = dungeon.getRooms().size() + dungeon.getDoors().size() + dungeon.getStairs().size();
+
+        sink.put(std::string_view("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                                  "<map version=\"1.10\" orientation=\"orthogonal\" renderorder=\"right-down\""));
+        attribute(sink, "width", width);
+        attribute(sink, "height", height);
+        attribute(sink, "tilewidth", size);
+        attribute(sink, "tileheight", size);
+        sink.put(std::string_view(" infinite=\"0\" nextlayerid=\"3\""));
+        attribute(sink, "nextobjectid", objects + 1);
+        sink.put(std::string_view(">\n <tileset firstgid=\"1\" name=\"rdg\""));
+        attribute(sink, "tilewidth", size);
+        attribute(sink, "tileheight", size);
+        attribute(sink, "tilecount", TILE_COUNT);
+        attribute(sink, "columns", TILE_COUNT);
+        sink.put(std::string_view("/>\n <layer id=\"1\" name=\"cells\""));
+        attribute(sink, "width", width);
+        attribute(sink, "height", height);
+        sink.put(std::string_view(">\n  <data encoding="));
+
+        if (encoding == CSV) {
+            sink.put(std::string_view("\"csv\">\n"));
+            for (long long r = 0; r < height; r++) {
+                for (long long c = 0; c < width; c++) {
+                    sink.put((long long) (tile(cells[r][c]) + 1));
+                    if (c + 1 < width || r + 1 < height) {
+                        sink.put(',');
+                    }
+                }
+                sink.put('\n');
+            }
+        } else {
+            sink.put(std::string_view("\"base64\" compression=\"zlib\">\n"));
+            if (!zlib_layer(cells, sink)) {
+                return false;
+            }
+            sink.put('\n');
+        }
+        sink.put(std::string_view("  </data>\n </layer>\n <objectgroup id=\"2\" name=\"features\">\n"));
+
+        long long id = 1;
+        for (const auto &room: dungeon.getRooms()) {
+            sink.put(std::string_view("  <object"));
+            attribute(sink, "id", id++);
+            sink.put(std::string_view(" name=\"room\" type=\"room\""));
+            attribute(sink, "x", room.west * size);
+            attribute(sink, "y", room.north * size);
+            attribute(sink, "width", room.width * size);
+            attribute(sink, "height", room.height * size);
+            sink.put(std::string_view(">\n   <properties><property name=\"id\" type=\"int\""));
+            attribute(sink, "value", room.id);
+            sink.put(std::string_view("/></properties>\n  </object>\n"));
+        }
+        for (const auto &door: dungeon.getDoors()) {
+            sink.put(std::string_view("  <object"));
+            attribute(sink, "id", id++);
+            attribute(sink, "name", door.type);
+            attribute(sink, "type", door.key);
+            attribute(sink, "x", door.col * size);
+            attribute(sink, "y", door.row * size);
+            attribute(sink, "width", size);
+            attribute(sink, "height", size);
+            sink.put(std::string_view(">\n   <properties><property name=\"dir\""));
+            attribute(sink, "value", door.dir);
+            sink.put(std::string_view("/><property name=\"out_id\" type=\"int\""));
+            attribute(sink, "value", door.out_id);
+            sink.put(std::string_view("/></properties>\n  </object>\n"));
+        }
+        for (const auto &stairs: dungeon.getStairs()) {
+            sink.put(std::string_view("  <object"));
+            attribute(sink, "id", id++);
+            sink.put(std::string_view(" name=\"stairs\""));
+            attribute(sink, "type", stairs.key);
+            attribute(sink, "x", stairs.col * size);
+            attribute(sink, "y", stairs.row * size);
+            attribute(sink, "width", size);
+            attribute(sink, "height", size);
+            sink.put(std::string_view(">\n   <properties><property name=\"next_row\" type=\"int\""));
+            attribute(sink, "value", stairs.next_row);
+            sink.put(std::string_view("/><property name=\"next_col\" type=\"int\""));
+            attribute(sink, "value", stairs.next_col);
+            sink.put(std::string_view("/></properties>\n  </object>\n"));
+        }
+        sink.put(std::string_view(" </objectgroup>\n</map>\n"));
+        return sink.flush();
+    }
+
+    static int tile(const Cell &cell) {
+        if (cell.hasType(rdg<T>::STAIR_DN)) {
+            return STAIR_DN_TILE;
+        } else if (cell.hasType(rdg<T>::STAIR_UP)) {
+            return STAIR_UP_TILE;
+        } else if (cell.hasType(rdg<T>::ARCH)) {
+            return ARCH_TILE;
+        } else if (cell.hasType(rdg<T>::DOOR)) {
+            return DOOR_TILE;
+        } else if (cell.hasType(rdg<T>::LOCKED)) {
+            return LOCKED_TILE;
+        } else if (cell.hasType(rdg<T>::TRAPPED)) {
+            return TRAPPED_TILE;
+        } else if (cell.hasType(rdg<T>::SECRET)) {
+            return SECRET_TILE;
+        } else if (cell.hasType(rdg<T>::PORTC)) {
+            return PORTC_TILE;
+        } else if (cell.hasType(rdg<T>::ROOM)) {
+            return ROOM_TILE;
+        } else if (cell.hasType(rdg<T>::CORRIDOR)) {
+            return CORRIDOR_TILE;
+        }
+        return NOTHING_TILE;
+    }
+
+private:
+    static void string(Sink &sink, std::string_view text) {
+        sink.put('"');
+        for (auto c: text) {
+            if (c == '"' || c == '\\') {
+                sink.put('\\');
+            }
+            sink.put(c);
+        }
+        sink.put('"');
+    }
+
+    static void field(Sink &sink, std::string_view name, long long value, bool first = false) {
+        if (!first) {
+            sink.put(',');
+        }
+        string(sink, name);
+        sink.put(':');
+        sink.put(value);
+    }
+
+    static void field(Sink &sink, std::string_view name, std::string_view value, bool first = false) {
+        if (!first) {
+            sink.put(',');
+        }
+        string(sink, name);
+        sink.put(':');
+        string(sink, value);
+    }
+
+    static void attribute(Sink &sink, std::string_view name, long long value) {
+        sink.put(' ');
+        sink.put(name);
+        sink.put(std::string_view("=\""));
+        sink.put(value);
+        sink.put('"');
+    }
+
+    //values here are generated keys and type names, which never need XML escaping
+    static void attribute(Sink &sink, std::string_view name, std::string_view value) {
+        sink.put(' ');
+        sink.put(name);
+        sink.put(std::string_view("=\""));
+        sink.put(value);
+        sink.put('"');
+    }
+
+    //base64 over a byte stream, carrying the last partial group between calls
+    class Base64 {
+    public:
+        explicit Base64(Sink &sink) : sink(sink) {}
+
+        void put(const unsigned char *data, size_t size) {
+            for (size_t k = 0; k < size; k++) {
+                carry[pending++] = data[k];
+                if (pending == 3) {
+                    emit(3);
+                }
+            }
+        }
+
+        void finish() {
+            if (pending) {
+                emit(pending);
+            }
+        }
+
+    private:
+        Sink &sink;
+        unsigned char carry[3] = {0, 0, 0};
+        int pending = 0;
+
+        void emit(int n) {
+            static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+            if (n < 3) {
+                std::fill(carry + n, carry + 3, 0);
+            }
+            uint32_t group = carry[0] << 16 | carry[1] << 8 | carry[2];
+            char out[4] = {alphabet[group >> 18 & 63], alphabet[group >> 12 & 63],
+                           n > 1 ? alphabet[group >> 6 & 63] : '=', n > 2 ? alphabet[group & 63] : '='};
+            sink.put(out, 4);
+            pending = 0;
+        }
+    };
+
+    template<typename Cells>
+    static bool zlib_layer(const Cells &cells, Sink &sink) {
+        z_stream stream{};
+        if (deflateInit(&stream, Z_BEST_SPEED) != Z_OK) {
+            return false;
+        }
+        Base64 base64(sink);
+        unsigned char in[1 << 14];
+        unsigned char out[1 << 14];
+        size_t used = 0;
+
+        //false on a deflate error or once the sink failed; Z_BUF_ERROR only means no progress was possible,
+        //which ends a chunk but must not happen before the stream ends
+        auto pump = [&](int flush) {
+            stream.next_in = in;
+            stream.avail_in = used;
+            used = 0;
+            int status;
+            do {
+                stream.next_out = out;
+                stream.avail_out = sizeof(out);
+                status = deflate(&stream, flush);
+                if (status == Z_STREAM_ERROR) {
+                    return false;
+                }
+                base64.put(out, sizeof(out) - stream.avail_out);
+            } while (status != Z_BUF_ERROR && sink.good()
+                     && (stream.avail_out == 0 || (flush == Z_FINISH && status != Z_STREAM_END)));
+            return sink.good() && (flush != Z_FINISH || status == Z_STREAM_END);
+        };
+
+        auto ok = true;
+        for (const auto &row: cells) {
+            for (const auto &cell: row) {
+                if (used + 4 > sizeof(in) && !(ok = pump(Z_NO_FLUSH))) {
+                    break;
+                }
+                uint32_t gid = tile(cell) + 1;
+                in[used++] = gid & 0xff;
+                in[used++] = gid >> 8 & 0xff;
+                in[used++] = gid >> 16 & 0xff;
+                in[used++] = gid >> 24 & 0xff;
+            }
+            if (!ok) {
+                break;
+            }
+        }
+        ok = ok && pump(Z_FINISH);
+        deflateEnd(&stream);
+        if (ok) {
+            base64.finish();
+        }
+        return ok && sink.good();
+    }
+};
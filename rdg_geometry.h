@@ -0,0 +1,165 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include "rdg.h"
+
+//wall outlines, solid blocks and door openings of a dungeon as flat arrays, in cell units:
+//cell (r, c) covers x from c to c + 1 and y from r to r + 1
+template<typename T=void>
+class rdg_geometry {
+public:
+    using Dungeon = typename rdg<T>::Dungeon;
+    using Cell = typename rdg<T>::Cell;
+
+    //side of a wall segment the open cells are on
+    enum Facing : int32_t {
+        NORTH,
+        SOUTH,
+        WEST,
+        EAST
+    };
+
+    struct Segment {
+        int32_t x1;
+        int32_t y1;
+        int32_t x2;
+        int32_t y2;
+        Facing facing;
+    };
+
+    struct Rect {
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+    };
+
+    struct Opening {
+        int32_t row;
+        int32_t col;
+        uint32_t type; //the door bit of the cell, 1 << ARCH ... 1 << PORTC
+        int32_t vertical; //1 when the passage through it runs north to south
+    };
+
+    struct Geometry {
+        std::vector<Segment> segments; //maximal runs of edges between open and solid cells
+        std::vector<Rect> rects; //solid cells, row runs merged down while they keep the same columns
+        std::vector<Opening> openings; //open door cells, which segments and rects treat as open space
+    };
+
+    static Geometry extract(const Dungeon &dungeon) {
+        Geometry geometry;
+        extract(dungeon, geometry);
+        return geometry;
+    }
+
+    //same as above, reusing the arrays of a previous result
+    static void extract(const Dungeon &dungeon, Geometry &geometry) {
+        const auto &cells = dungeon.getCells();
+        int n_rows = cells.size();
+        int n_cols = cells.stride();
+        geometry.segments.clear();
+        geometry.rects.clear();
+        geometry.openings.clear();
+
+        //open bits by row, and by column in transposed, with an all-solid line on either side
+        auto words = (n_cols + 63) / 64;
+        auto t_words = (n_rows + 63) / 64;
+        std::vector<uint64_t> open(size_t(n_rows + 2) * words, 0);
+        std::vector<uint64_t> transposed(size_t(n_cols + 2) * t_words, 0);
+        for (int r = 0; r < n_rows; r++) {
+            for (int c = 0; c < n_cols; c++) {
+                const auto &cell = cells[r][c];
+                if (!cell.isOpenspace()) {
+                    continue;
+                }
+                open[size_t(r + 1) * words + (c >> 6)] |= uint64_t(1) << (c & 63);
+                transposed[size_t(c + 1) * t_words + (r >> 6)] |= uint64_t(1) << (r & 63);
+                if (cell.isDoorspace()) {
+                    auto vertical = r > 0 && r + 1 < n_rows && cells[r - 1][c].isOpenspace()
+                                    && cells[r + 1][c].isOpenspace();
+                    geometry.openings.push_back({r, c, cell.getFlags() & rdg<T>::DOORSPACE, vertical});
+                }
+            }
+        }
+
+        std::vector<uint64_t> edge(std::max(words, t_words));
+        for (int y = 0; y <= n_rows; y++) {
+            auto *above = &open[size_t(y) * words];
+            auto *below = &open[size_t(y + 1) * words];
+            for (int w = 0; w < words; w++) {
+                edge[w] = below[w] & ~above[w];
+            }
+            runs(edge.data(), n_cols, [&](int c1, int c2) {
+                geometry.segments.push_back({c1, y, c2 + 1, y, SOUTH});
+            });
+            for (int w = 0; w < words; w++) {
+                edge[w] = above[w] & ~below[w];
+            }
+            runs(edge.data(), n_cols, [&](int c1, int c2) {
+                geometry.segments.push_back({c1, y, c2 + 1, y, NORTH});
+            });
+        }
+        for (int x = 0; x <= n_cols; x++) {
+            auto *left = &transposed[size_t(x) * t_words];
+            auto *right = &transposed[size_t(x + 1) * t_words];
+            for (int w = 0; w < t_words; w++) {
+                edge[w] = right[w] & ~left[w];
+            }
+            runs(edge.data(), n_rows, [&](int r1, int r2) {
+                geometry.segments.push_back({x, r1, x, r2 + 1, EAST});
+            });
+            for (int w = 0; w < t_words; w++) {
+                edge[w] = left[w] & ~right[w];
+            }
+            runs(edge.data(), n_rows, [&](int r1, int r2) {
+                geometry.segments.push_back({x, r1, x, r2 + 1, WEST});
+            });
+        }
+
+        //solid runs of each row either continue a rectangle with the same columns or start one
+        std::vector<size_t> growing;
+        std::vector<size_t> next;
+        std::vector<uint64_t> solid(words);
+        for (int r = 0; r < n_rows; r++) {
+            auto *row = &open[size_t(r + 1) * words];
+            for (int w = 0; w < words; w++) {
+                solid[w] = ~row[w];
+            }
+            next.clear();
+            size_t k = 0;
+            runs(solid.data(), n_cols, [&](int c1, int c2) {
+                while (k < growing.size() && geometry.rects[growing[k]].x < c1) {
+                    k++;
+                }
+                if (k < growing.size() && geometry.rects[growing[k]].x == c1
+                    && geometry.rects[growing[k]].width == c2 - c1 + 1) {
+                    geometry.rects[growing[k]].height++;
+                    next.push_back(growing[k++]);
+                } else {
+                    next.push_back(geometry.rects.size());
+                    geometry.rects.push_back({c1, r, c2 - c1 + 1, 1});
+                }
+            });
+            growing.swap(next);
+        }
+    }
+
+private:
+    //calls f(first, last) for every run of set bits among the first n
+    template<typename F>
+    static void runs(const uint64_t *bits, int n, F f) {
+        auto words = (n + 63) / 64;
+        int c = 0;
+        while (c < n) {
+            c = rdg<T>::scan_bits(bits, words, c, true);
+            if (c >= n) {
+                return;
+            }
+            auto end = std::min(rdg<T>::scan_bits(bits, words, c, false), n);
+            f(c, end - 1);
+            c = end;
+        }
+    }
+};
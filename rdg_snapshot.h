@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+#include "rdg.h"
+
+//one generated dungeon shared read-only between sessions, each editing it through a copy-on-write view
+template<typename T=void>
+class rdg_snapshot {
+public:
+    using Dungeon = typename rdg<T>::Dungeon;
+    using Cell = typename rdg<T>::Cell;
+    using Room = typename rdg<T>::Room;
+    using Door = typename rdg<T>::Door;
+    using Journal = typename rdg<T>::Journal;
+
+    //edits copy TILE x TILE cells at a time
+    static constexpr int TILE = 8;
+
+    //immutable once created, so any number of threads can read it through the shared pointer
+    class Snapshot {
+    public:
+        static std::shared_ptr<const Snapshot> create(Dungeon dungeon) {
+            return std::shared_ptr<const Snapshot>(new Snapshot(std::move(dungeon)));
+        }
+
+        const Dungeon &getDungeon() const {
+            return dungeon;
+        }
+
+    private:
+        const Dungeon dungeon;
+
+        explicit Snapshot(Dungeon dungeon) : dungeon(std::move(dungeon)) {}
+    };
+
+    //a session's dungeon: reads fall through to the snapshot except for the tiles, rooms and doors it
+    //changed, which are the only things it stores
+    class View {
+    public:
+        explicit View(std::shared_ptr<const Snapshot> snapshot) :
+                snapshot(std::move(snapshot)),
+                tiles_j(int((this->snapshot->getDungeon().getCells().stride() + TILE - 1) / TILE)) {}
+
+        const Snapshot &getSnapshot() const {
+            return *snapshot;
+        }
+
+        size_t getRows() const {
+            return base().getCells().size();
+        }
+
+        size_t getCols() const {
+            return base().getCells().stride();
+        }
+
+        const Cell &getCell(int r, int c) const {
+            if (!tile_index.empty()) {
+                auto it = tile_index.find(tile_of(r, c));
+                if (it != tile_index.end()) {
+                    return tiles[it->second][(r % TILE) * TILE + c % TILE];
+                }
+            }
+            return base().getCells()[r][c];
+        }
+
+        //changes one cell through f(Cell &), copying its tile out of the snapshot first
+        template<typename F>
+        void edit(int r, int c, F f) {
+            auto &cell = own_cell(r, c);
+            auto before = cell.getFlags();
+            f(cell);
+            if (journaling && cell.getFlags() != before) {
+                journal.record(uint32_t(r * getCols() + c), before, cell.getFlags());
+            }
+        }
+
+        //rooms by id, starting at 1
+        const Room &getRoom(int id) const {
+            auto it = rooms.find(id);
+            return it != rooms.end() ? it->second : base().getRooms()[id - 1];
+        }
+
+        template<typename F>
+        void editRoom(int id, F f) {
+            auto it = rooms.try_emplace(id, base().getRooms()[id - 1]).first;
+            f(it->second);
+        }
+
+        //doors by their index in getDoors() of the snapshot
+        const Door &getDoor(size_t index) const {
+            auto it = doors.find(index);
+            return it != doors.end() ? it->second : base().getDoors()[index];
+        }
+
+        template<typename F>
+        void editDoor(size_t index, F f) {
+            auto it = doors.try_emplace(index, base().getDoors()[index]).first;
+            f(it->second);
+        }
+
+        Journal &getJournal() {
+            return journal;
+        }
+
+        bool isJournaling() const {
+            return journaling;
+        }
+
+        void setJournaling(bool journaling) {
+            this->journaling = journaling;
+        }
+
+        //bytes held by the view's own copies, the snapshot not included
+        size_t getFootprint() const {
+            return sizeof(*this)
+                   + tiles.capacity() * sizeof(Tile)
+                   + tile_index.size() * (sizeof(typename decltype(tile_index)::value_type) + sizeof(void *))
+                   + rooms.size() * (sizeof(typename decltype(rooms)::value_type) + sizeof(void *))
+                   + doors.size() * (sizeof(typename decltype(doors)::value_type) + sizeof(void *));
+        }
+
+    private:
+        using Tile = std::array<Cell, TILE * TILE>;
+
+        std::shared_ptr<const Snapshot> snapshot;
+        int tiles_j;
+        std::unordered_map<uint32_t, uint32_t> tile_index; //tile number to its copy in tiles
+        std::vector<Tile> tiles;
+        std::unordered_map<int, Room> rooms;
+        std::unordered_map<size_t, Door> doors;
+        Journal journal;
+        bool journaling = false;
+
+        const Dungeon &base() const {
+            return snapshot->getDungeon();
+        }
+
+        uint32_t tile_of(int r, int c) const {
+            return uint32_t(r / TILE) * tiles_j + c / TILE;
+        }
+
+        Cell &own_cell(int r, int c) {
+            auto [it, copied] = tile_index.try_emplace(tile_of(r, c), uint32_t(tiles.size()));
+            if (copied) {
+                const auto &cells = base().getCells();
+                auto r1 = r / TILE * TILE;
+                auto c1 = c / TILE * TILE;
+                auto &tile = tiles.emplace_back();
+                for (int dr = 0; dr < TILE && r1 + dr < int(cells.size()); dr++) {
+                    for (int dc = 0; dc < TILE && c1 + dc < int(cells.stride()); dc++) {
+                        tile[dr * TILE + dc] = cells[r1 + dr][c1 + dc];
+                    }
+                }
+            }
+            return tiles[it->second][(r % TILE) * TILE + c % TILE];
+        }
+    };
+};
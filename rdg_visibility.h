@@ -0,0 +1,414 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+#include "rdg.h"
+
+//field of view and potentially visible sets over a generated dungeon
+template<typename T=void>
+class rdg_visibility {
+public:
+    using Dungeon = typename rdg<T>::Dungeon;
+    using Cell = typename rdg<T>::Cell;
+    using Delta = typename rdg<T>::Delta;
+
+    //one bit per cell, rows padded to whole words
+    class Bitmap {
+    public:
+        void assign(int rows, int cols) {
+            n_rows = rows;
+            n_cols = cols;
+            words = (cols + 63) / 64;
+            bits.assign(size_t(rows) * words, 0);
+        }
+
+        int getRows() const {
+            return n_rows;
+        }
+
+        int getCols() const {
+            return n_cols;
+        }
+
+        bool get(int r, int c) const {
+            if (r < 0 || r >= n_rows || c < 0 || c >= n_cols) {
+                return false;
+            }
+            return (row(r)[c >> 6] >> (c & 63)) & 1;
+        }
+
+        void set(int r, int c, bool value) {
+            auto &word = row(r)[c >> 6];
+            auto bit = uint64_t(1) << (c & 63);
+            word = value ? word | bit : word & ~bit;
+        }
+
+        //sets columns c1 to c2 of row r
+        void fill(int r, int c1, int c2) {
+            auto *words = row(r);
+            for (int w = c1 >> 6; w <= c2 >> 6; w++) {
+                auto mask = ~uint64_t(0);
+                if (w == c1 >> 6) {
+                    mask &= ~uint64_t(0) << (c1 & 63);
+                }
+                if (w == c2 >> 6) {
+                    mask &= ~uint64_t(0) >> (63 - (c2 & 63));
+                }
+                words[w] |= mask;
+            }
+        }
+
+        //first column in [from, to] of row r whose bit equals value, to + 1 when there is none
+        int next(int r, int from, int to, bool value) const {
+            return std::min(rdg<T>::scan_bits(row(r), (to >> 6) + 1, from, value), to + 1);
+        }
+
+        uint64_t *row(int r) {
+            return bits.data() + size_t(r) * words;
+        }
+
+        const uint64_t *row(int r) const {
+            return bits.data() + size_t(r) * words;
+        }
+
+    private:
+        int n_rows = 0;
+        int n_cols = 0;
+        int words = 0;
+        std::vector<uint64_t> bits;
+    };
+
+    //builds the opacity bitmaps and the visible set of every room and corridor segment
+    explicit rdg_visibility(const Dungeon &dungeon) {
+        const auto &cells = dungeon.getCells();
+        n_rows = cells.size();
+        n_cols = cells.stride();
+        opacity.assign(n_rows, n_cols);
+        transposed.assign(n_cols, n_rows);
+        for (int r = 0; r < n_rows; r++) {
+            for (int c = 0; c < n_cols; c++) {
+                set_opaque(r, c, isOpaque(cells[r][c]));
+            }
+        }
+
+        index_regions(dungeon);
+        scratch.assign(n_rows, n_cols);
+        visible.resize(n_regions);
+        seen.assign(size_t(n_regions) * region_words, 0);
+        for (int region = 0; region < n_regions; region++) {
+            compute(region);
+        }
+    }
+
+    //anything that is not a room or corridor blocks sight, and so do secret and locked doors
+    static bool isOpaque(const Cell &cell) {
+        return !cell.isOpenspace()
+               || cell.hasType(rdg<T>::SECRET)
+               || cell.hasType(rdg<T>::LOCKED);
+    }
+
+    bool isOpaque(int r, int c) const {
+        return opacity.get(r, c);
+    }
+
+    //adds the cells visible from (r, c) within radius rows or columns to out, which has the dungeon's size;
+    //symmetric shadowcasting that walks each row of a quadrant as runs of the packed opacity bits
+    void fov(int r, int c, int radius, Bitmap &out) {
+        Box box;
+        cast(r, c, radius, out, box, false);
+    }
+
+    //room id - 1 for room cells, a corridor segment after the rooms for corridor cells, -1 otherwise
+    int getRegion(int r, int c) const {
+        return regions[size_t(r) * n_cols + c];
+    }
+
+    int getRegionCount() const {
+        return n_regions;
+    }
+
+    //whether (r2, c2) may be seen from anywhere in the region of (r1, c1), never false when fov() lights it
+    bool maySee(int r1, int c1, int r2, int c2) const {
+        auto region = getRegion(r1, c1);
+        return region >= 0 && visible[region].get(r2, c2);
+    }
+
+    //whether any cell of region b may be seen from region a
+    bool maySeeRegion(int a, int b) const {
+        return (seen[size_t(a) * region_words + (b >> 6)] >> (b & 63)) & 1;
+    }
+
+    //whether any cell set in cells, a bitmap of the dungeon's size, may be seen from the region
+    bool maySee(int region, const Bitmap &cells) const {
+        const auto &pvs = visible[region];
+        for (int r = 0; r < pvs.n_rows; r++) {
+            auto *words = cells.row(pvs.r1 + r) + pvs.w1;
+            for (int w = 0; w < pvs.n_words; w++) {
+                if (pvs.bits[size_t(r) * pvs.n_words + w] & words[w]) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    //applies a changed cell, recomputing the visible sets that saw it when its opacity flipped
+    bool update(int r, int c, const Cell &cell) {
+        if (!set_opaque(r, c, isOpaque(cell))) {
+            return false;
+        }
+        for (int region = 0; region < n_regions; region++) {
+            if (visible[region].get(r, c)) {
+                compute(region);
+            }
+        }
+        return true;
+    }
+
+    //applies journaled changes, recomputing each affected visible set once
+    void update(const std::vector<Delta> &deltas) {
+        std::vector<char> dirty(n_regions, 0);
+        for (const auto &delta: deltas) {
+            int r = delta.index / n_cols;
+            int c = delta.index % n_cols;
+            Cell cell;
+            cell.setFlags(delta.after);
+            if (!set_opaque(r, c, isOpaque(cell))) {
+                continue;
+            }
+            for (int region = 0; region < n_regions; region++) {
+                dirty[region] = dirty[region] || visible[region].get(r, c);
+            }
+        }
+        for (int region = 0; region < n_regions; region++) {
+            if (dirty[region]) {
+                compute(region);
+            }
+        }
+    }
+
+private:
+    //corridor cells are grouped into SEGMENT x SEGMENT blocks
+    static constexpr int SEGMENT = 16;
+
+    //visible set of a region, cropped to the word-aligned bounding box of what it sees
+    struct Pvs {
+        int r1 = 0;
+        int w1 = 0;
+        int n_rows = 0;
+        int n_words = 0;
+        std::vector<uint64_t> bits;
+
+        bool get(int r, int c) const {
+            r -= r1;
+            auto w = (c >> 6) - w1;
+            if (r < 0 || r >= n_rows || w < 0 || w >= n_words) {
+                return false;
+            }
+            return (bits[size_t(r) * n_words + w] >> (c & 63)) & 1;
+        }
+    };
+
+    struct Box {
+        int r1 = INT_MAX;
+        int c1 = INT_MAX;
+        int r2 = -1;
+        int c2 = -1;
+
+        void add(int r_from, int c_from, int r_to, int c_to) {
+            r1 = std::min(r1, r_from);
+            c1 = std::min(c1, c_from);
+            r2 = std::max(r2, r_to);
+            c2 = std::max(c2, c_to);
+        }
+    };
+
+    //row of a quadrant at depth, between the slopes start_num / start_den and end_num / end_den
+    struct Row {
+        int depth;
+        int start_num;
+        int start_den;
+        int end_num;
+        int end_den;
+    };
+
+    int n_rows = 0;
+    int n_cols = 0;
+    Bitmap opacity;
+    Bitmap transposed; //columns as rows, so east and west quadrants also scan runs within words
+    std::vector<int> regions;
+    int n_regions = 0;
+    int region_words = 0;
+    std::vector<int> region_offsets;
+    std::vector<int> region_cells;
+    std::vector<Pvs> visible;
+    std::vector<uint64_t> seen; //per region, a bit for every region it sees into
+    Bitmap scratch;
+    std::vector<Row> stack;
+
+    static int floor_div(int a, int b) {
+        return a >= 0 ? a / b : -((-a + b - 1) / b);
+    }
+
+    static int ceil_div(int a, int b) {
+        return -floor_div(-a, b);
+    }
+
+    //returns whether the opacity changed
+    bool set_opaque(int r, int c, bool opaque) {
+        if (opacity.get(r, c) == opaque) {
+            return false;
+        }
+        opacity.set(r, c, opaque);
+        transposed.set(c, r, opaque);
+        return true;
+    }
+
+    void index_regions(const Dungeon &dungeon) {
+        const auto &cells = dungeon.getCells();
+        auto n_rooms = int(dungeon.getRooms().size());
+        auto blocks_j = (n_cols + SEGMENT - 1) / SEGMENT;
+        std::vector<int> segments(size_t((n_rows + SEGMENT - 1) / SEGMENT) * blocks_j, -1);
+
+        n_regions = n_rooms;
+        regions.assign(size_t(n_rows) * n_cols, -1);
+        for (int r = 0; r < n_rows; r++) {
+            for (int c = 0; c < n_cols; c++) {
+                const auto &cell = cells[r][c];
+                auto &region = regions[size_t(r) * n_cols + c];
+                if (cell.hasType(rdg<T>::ROOM)) {
+                    region = cell.getRoomId() - 1;
+                } else if (cell.isOpenspace()) {
+                    auto &segment = segments[(r / SEGMENT) * blocks_j + c / SEGMENT];
+                    if (segment < 0) {
+                        segment = n_regions++;
+                    }
+                    region = segment;
+                }
+            }
+        }
+        region_words = (n_regions + 63) / 64;
+
+        region_offsets.assign(n_regions + 1, 0);
+        for (auto region: regions) {
+            if (region >= 0) {
+                region_offsets[region + 1]++;
+            }
+        }
+        for (int region = 0; region < n_regions; region++) {
+            region_offsets[region + 1] += region_offsets[region];
+        }
+        region_cells.resize(region_offsets[n_regions]);
+        auto fill = region_offsets;
+        for (size_t k = 0; k < regions.size(); k++) {
+            if (regions[k] >= 0) {
+                region_cells[fill[regions[k]]++] = int(k);
+            }
+        }
+    }
+
+    //unions every cell the shadowcasts from the region reach, then moves it out of the scratch bitmap;
+    //floor the symmetry rule leaves dark is kept, as it is lit once it turns into a wall
+    void compute(int region) {
+        Box box;
+        for (int k = region_offsets[region]; k < region_offsets[region + 1]; k++) {
+            cast(region_cells[k] / n_cols, region_cells[k] % n_cols, INT_MAX, scratch, box, true);
+        }
+
+        auto &pvs = visible[region];
+        auto *regions_seen = &seen[size_t(region) * region_words];
+        std::fill(regions_seen, regions_seen + region_words, 0);
+        if (box.r2 < 0) {
+            pvs.n_rows = pvs.n_words = 0;
+            pvs.bits.clear();
+            return;
+        }
+        pvs.r1 = box.r1;
+        pvs.w1 = box.c1 >> 6;
+        pvs.n_rows = box.r2 - box.r1 + 1;
+        pvs.n_words = (box.c2 >> 6) - pvs.w1 + 1;
+        pvs.bits.resize(size_t(pvs.n_rows) * pvs.n_words);
+        for (int r = 0; r < pvs.n_rows; r++) {
+            auto *words = scratch.row(pvs.r1 + r) + pvs.w1;
+            for (int w = 0; w < pvs.n_words; w++) {
+                pvs.bits[size_t(r) * pvs.n_words + w] = words[w];
+                for (auto bits = words[w]; bits; bits &= bits - 1) {
+                    auto c = (pvs.w1 + w) * 64 + rdg<T>::ctz64(bits);
+                    auto other = regions[size_t(pvs.r1 + r) * n_cols + c];
+                    if (other >= 0) {
+                        regions_seen[other >> 6] |= uint64_t(1) << (other & 63);
+                    }
+                }
+                words[w] = 0;
+            }
+        }
+    }
+
+    void cast(int r, int c, int radius, Bitmap &out, Box &box, bool reached) {
+        out.set(r, c, true);
+        box.add(r, c, r, c);
+
+        //north and south walk rows of opacity, west and east rows of transposed
+        for (int quadrant = 0; quadrant < 4; quadrant++) {
+            auto vertical = quadrant < 2;
+            auto sign = quadrant % 2 ? 1 : -1;
+            const auto &bitmap = vertical ? opacity : transposed;
+            auto origin_line = vertical ? r : c;
+            auto origin_offset = vertical ? c : r;
+
+            stack.clear();
+            stack.push_back({1, -1, 1, 1, 1});
+            while (!stack.empty()) {
+                auto row = stack.back();
+                stack.pop_back();
+                auto line = origin_line + sign * row.depth;
+                if (row.depth > radius || line < 0 || line >= bitmap.getRows()) {
+                    continue;
+                }
+                auto min_col = floor_div(2 * row.depth * row.start_num + row.start_den, 2 * row.start_den);
+                auto max_col = ceil_div(2 * row.depth * row.end_num - row.end_den, 2 * row.end_den);
+                auto first = std::max(min_col, -origin_offset);
+                auto last = std::min(max_col, bitmap.getCols() - 1 - origin_offset);
+
+                for (auto a = first; a <= last;) {
+                    auto wall = bitmap.get(line, origin_offset + a);
+                    auto b = bitmap.next(line, origin_offset + a, origin_offset + last, !wall) - origin_offset - 1;
+                    auto lit_first = a;
+                    auto lit_last = b;
+                    if (!wall) {
+                        //floor is lit only where it is symmetric, i.e. its centre lies between the slopes
+                        if (!reached) {
+                            lit_first = std::max(a, ceil_div(row.depth * row.start_num, row.start_den));
+                            lit_last = std::min(b, floor_div(row.depth * row.end_num, row.end_den));
+                        }
+
+                        Row next = {row.depth + 1, row.start_num, row.start_den, row.end_num, row.end_den};
+                        if (a > min_col) {
+                            next.start_num = 2 * a - 1;
+                            next.start_den = 2 * row.depth;
+                        }
+                        if (b < max_col) {
+                            next.end_num = 2 * b + 1;
+                            next.end_den = 2 * row.depth;
+                        }
+                        stack.push_back(next);
+                    }
+                    if (lit_first <= lit_last) {
+                        if (vertical) {
+                            out.fill(line, origin_offset + lit_first, origin_offset + lit_last);
+                            box.add(line, origin_offset + lit_first, line, origin_offset + lit_last);
+                        } else {
+                            for (auto k = lit_first; k <= lit_last; k++) {
+                                out.set(origin_offset + k, line, true);
+                            }
+                            box.add(origin_offset + lit_first, line, origin_offset + lit_last, line);
+                        }
+                    }
+                    a = b + 1;
+                }
+            }
+        }
+    }
+};